@@ -0,0 +1,162 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAKit/VMAPlatform.hpp"
+#include "Primitives.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only primitives for offline analysis of physical memory dumps
+// Dump files are memory mapped and virtual addresses are pointers into mapped content, so address conversion
+// and reads are plain pointer arithmetic. Dumps should be added before use, after that object can be shared
+// (or copied) between threads
+class MappedDumpPrimitives : public Primitives
+{
+public:
+
+	MappedDumpPrimitives()
+	{}
+
+	// Maps dump file with content of physical memory starting at physicalBase
+	bool addDump(const char* path, phys_addr_t physicalBase)
+	{
+		if (path == nullptr)
+			return false;
+
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size <= 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		size_t size = size_t(info.st_size);
+		void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		if (data == MAP_FAILED)
+			return false;
+
+		// mapping is shared by copies of primitives (e.g. walkers created by PageRelocator)
+		std::shared_ptr<void> mapping(data, [size] (void* mappedData) { munmap(mappedData, size); });
+
+		return addRegion(physicalBase, size, (const uint8_t*)data, mapping);
+	}
+
+	// Adds dump which is already loaded, memory should stay valid while primitives are used
+	bool addMemory(const void* data, size_t size, phys_addr_t physicalBase)
+	{
+		if (data == nullptr || size == 0)
+			return false;
+
+		return addRegion(physicalBase, size, (const uint8_t*)data, nullptr);
+	}
+
+	// Read
+
+	uintptr_t	readAddress(virt_addr_t address)
+	{
+		uintptr_t value;
+		memcpy(&value, (const void*)address, sizeof(value));
+		return value;
+	}
+
+	bool		readBlock(virt_addr_t address, void* dst, size_t size)
+	{
+		memcpy(dst, (const void*)address, size);
+		return true;
+	}
+
+	// Concurrency
+
+	bool		isThreadSafe()
+	{
+		// regions are not modified after setup and dumps are read-only
+		return true;
+	}
+
+	// Virtual <-> Physical address conversion
+
+	phys_addr_t virtualToPhysical(virt_addr_t address)
+	{
+		for (auto& region : m_regions)
+		{
+			virt_addr_t regionAddress = virt_addr_t(region.data);
+			if (address >= regionAddress && address - regionAddress < region.size)
+				return region.physicalBase + (address - regionAddress);
+		}
+
+		return kInvalidAddress;
+	}
+
+	virt_addr_t physicalToVirtual(phys_addr_t address)
+	{
+		// regions are sorted by physical address, find last one starting at or below address
+		auto region = std::upper_bound(m_regions.begin(), m_regions.end(), address,
+									   [] (phys_addr_t address, const Region& region) { return address < region.physicalBase; });
+		if (region == m_regions.begin())
+			return kInvalidAddress;
+
+		region--;
+		if (address - region->physicalBase >= region->size)
+			return kInvalidAddress;
+
+		return virt_addr_t(region->data + (address - region->physicalBase));
+	}
+
+private:
+
+	struct Region
+	{
+		phys_addr_t				physicalBase;
+		size_t					size;
+		const uint8_t*			data;
+		std::shared_ptr<void>	mapping;
+	};
+
+	bool addRegion(phys_addr_t physicalBase, size_t size, const uint8_t* data, std::shared_ptr<void> mapping)
+	{
+		// physical ranges of dumps can't overlap
+		for (auto& region : m_regions)
+		{
+			if (physicalBase < region.physicalBase + region.size && region.physicalBase < physicalBase + size)
+				return false;
+		}
+
+		Region region = {
+			.physicalBase = physicalBase,
+			.size = size,
+			.data = data,
+			.mapping = mapping
+		};
+
+		auto position = std::upper_bound(m_regions.begin(), m_regions.end(), physicalBase,
+										 [] (phys_addr_t address, const Region& region) { return address < region.physicalBase; });
+		m_regions.insert(position, region);
+
+		return true;
+	}
+
+private:
+
+	std::vector<Region>	m_regions;
+};
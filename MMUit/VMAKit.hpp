@@ -15,5 +15,11 @@
 #include "VMAKit/TTEntry.hpp"
 
 #include "VMAKit/MMUConfig.hpp"
+#include "VMAKit/TTScan.hpp"
+#include "VMAKit/TTCache.hpp"
+#include "VMAKit/AddressMap.hpp"
+#include "VMAKit/PagePool.hpp"
+#include "VMAKit/RelocationJournal.hpp"
 #include "VMAKit/TTWalker.hpp"
+#include "VMAKit/StaticTTWalker.hpp"
 #include "VMAKit/PageRelocator.hpp"
@@ -0,0 +1,270 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+struct PagePoolStats
+{
+	uint64_t	allocations;			// pages handed out
+	uint64_t	primitiveAllocations;	// allocInPhysicalMemory calls
+	uint64_t	primitiveDeallocations;	// deallocInPhysicalMemory calls
+	uint64_t	freePages;				// pages kept by pool
+	uint64_t	chunks;					// chunks owned by pool
+};
+
+// Pool of granule sized physical pages carved from large chunks allocated with primitives
+// Freed pages are kept for reuse, new chunk is allocated when number of free pages drops below low watermark
+// and chunks which are entirely free are returned when number of free pages exceeds high watermark.
+// Disabled pool allocates and deallocates every page with primitives.
+template <typename PRIMITIVES>
+class PhysicalPagePool
+{
+public:
+
+	static const uint32_t kDefaultChunkPages = 64;
+	static const uint32_t kDefaultLowWatermark = 8;
+	static const uint32_t kDefaultHighWatermark = 2 * kDefaultChunkPages;
+
+	// ChunkCallback is called when chunk is allocated (allocated is true) or returned to primitives
+	using ChunkCallback = std::function<void(virt_addr_t address, uint32_t pages, bool allocated)>;
+
+public:
+
+	PhysicalPagePool() = delete;
+	PhysicalPagePool(const PhysicalPagePool&) = delete;
+	PhysicalPagePool& operator=(const PhysicalPagePool&) = delete;
+
+	PhysicalPagePool(PRIMITIVES& primitives, uint32_t pageSize)
+		: m_primitives(primitives), m_pageSize(pageSize)
+	{
+		resetStats();
+	}
+
+	~PhysicalPagePool()
+	{
+		// pages still in use stay allocated
+		releaseFreeChunks(0);
+	}
+
+	// Zero chunkPages disables pool, pages allocated from pool before are still returned to it
+	// Statistics are counted from the last configuration
+	void configure(uint32_t chunkPages, uint32_t lowWatermark, uint32_t highWatermark)
+	{
+		assert(lowWatermark <= highWatermark);
+
+		resetStats();
+
+		m_chunkPages = chunkPages;
+		m_lowWatermark = (chunkPages != 0)? lowWatermark : 0;
+		m_highWatermark = (chunkPages != 0)? highWatermark : 0;
+
+		if (m_freePages.size() > m_highWatermark)
+			releaseFreeChunks(m_lowWatermark);
+	}
+
+	bool isEnabled() const
+	{
+		return m_chunkPages != 0;
+	}
+
+	virt_addr_t allocPage()
+	{
+		m_stats.allocations++;
+
+		if (isEnabled() == false)
+		{
+			m_stats.primitiveAllocations++;
+			return m_primitives.allocInPhysicalMemory(m_pageSize);
+		}
+
+		if (m_freePages.empty() && addChunk() == false)
+			return kInvalidAddress;
+
+		virt_addr_t page = m_freePages.back();
+		m_freePages.pop_back();
+		findChunk(page)->freePages--;
+
+		// refill before pool is exhausted
+		if (m_freePages.size() < m_lowWatermark)
+			addChunk();
+
+		return page;
+	}
+
+	bool freePage(virt_addr_t page)
+	{
+		// page could be allocated before pool was enabled
+		Chunk* chunk = findChunk(page);
+		if (chunk == nullptr)
+		{
+			m_stats.primitiveDeallocations++;
+			return m_primitives.deallocInPhysicalMemory(page, m_pageSize);
+		}
+
+		chunk->freePages++;
+		m_freePages.push_back(page);
+
+		if (m_freePages.size() > m_highWatermark)
+			releaseFreeChunks(m_lowWatermark);
+
+		return true;
+	}
+
+	void setChunkCallback(ChunkCallback callback)
+	{
+		m_chunkCallback = callback;
+	}
+
+	// Takes ownership of chunk allocated by another pool (e.g. recovered from journal), all its pages are in use
+	// and are returned to chunk by freePage
+	bool adoptChunk(virt_addr_t address, uint32_t pages)
+	{
+		if (pages == 0 || (address & (m_pageSize - 1)) != 0 || findChunk(address) != nullptr)
+			return false;
+
+		Chunk chunk = {
+			.address = address,
+			.pages = pages,
+			.freePages = 0
+		};
+		insertChunk(chunk);
+
+		return true;
+	}
+
+	template <typename CALLBACK>
+	void forEachChunk(CALLBACK callback)
+	{
+		for (auto& chunk : m_chunks)
+			callback(chunk.address, chunk.pages);
+	}
+
+	PagePoolStats getStats() const
+	{
+		PagePoolStats stats = m_stats;
+		stats.freePages = m_freePages.size();
+		stats.chunks = m_chunks.size();
+		return stats;
+	}
+
+	void resetStats()
+	{
+		m_stats.allocations = 0;
+		m_stats.primitiveAllocations = 0;
+		m_stats.primitiveDeallocations = 0;
+	}
+
+private:
+
+	struct Chunk
+	{
+		virt_addr_t	address;
+		uint32_t	pages;
+		uint32_t	freePages;
+	};
+
+	bool addChunk()
+	{
+		virt_addr_t address = m_primitives.allocInPhysicalMemory(m_chunkPages * m_pageSize);
+		m_stats.primitiveAllocations++;
+
+		if (address == kInvalidAddress || address == 0)
+			return false;
+
+		assert((address & (m_pageSize - 1)) == 0);
+
+		Chunk chunk = {
+			.address = address,
+			.pages = m_chunkPages,
+			.freePages = m_chunkPages
+		};
+		insertChunk(chunk);
+
+		// pages are taken from the back, so the first page of chunk is used first
+		for (uint32_t page = m_chunkPages; page != 0; page--)
+			m_freePages.push_back(address + (page - 1) * m_pageSize);
+
+		if (m_chunkCallback)
+			m_chunkCallback(address, m_chunkPages, true);
+
+		return true;
+	}
+
+	void insertChunk(const Chunk& chunk)
+	{
+		auto position = std::upper_bound(m_chunks.begin(), m_chunks.end(), chunk.address,
+										 [] (virt_addr_t address, const Chunk& chunk) { return address < chunk.address; });
+		m_chunks.insert(position, chunk);
+	}
+
+	Chunk* findChunk(virt_addr_t page)
+	{
+		// chunks are sorted by address, find last one starting at or below page
+		auto chunk = std::upper_bound(m_chunks.begin(), m_chunks.end(), page,
+									  [] (virt_addr_t address, const Chunk& chunk) { return address < chunk.address; });
+		if (chunk == m_chunks.begin())
+			return nullptr;
+
+		chunk--;
+		if (page - chunk->address >= virt_addr_t(chunk->pages) * m_pageSize)
+			return nullptr;
+
+		return &(*chunk);
+	}
+
+	// Returns entirely free chunks to primitives while at least keepPages free pages remain
+	void releaseFreeChunks(size_t keepPages)
+	{
+		size_t freePages = m_freePages.size();
+		bool released = false;
+
+		for (auto& chunk : m_chunks)
+		{
+			if (chunk.freePages != chunk.pages || freePages < keepPages + chunk.pages)
+				continue;
+
+			m_primitives.deallocInPhysicalMemory(chunk.address, chunk.pages * m_pageSize);
+			m_stats.primitiveDeallocations++;
+
+			if (m_chunkCallback)
+				m_chunkCallback(chunk.address, chunk.pages, false);
+
+			freePages -= chunk.pages;
+			chunk.pages = 0;
+			released = true;
+		}
+
+		if (released == false)
+			return;
+
+		// drop pages of released chunks (they are not found anymore) and the chunks themselves
+		m_chunks.erase(std::remove_if(m_chunks.begin(), m_chunks.end(), [] (const Chunk& chunk) { return chunk.pages == 0; }), m_chunks.end());
+		m_freePages.erase(std::remove_if(m_freePages.begin(), m_freePages.end(), [this] (virt_addr_t page) { return findChunk(page) == nullptr; }), m_freePages.end());
+	}
+
+private:
+
+	PRIMITIVES&	m_primitives;
+	uint32_t	m_pageSize;
+
+	uint32_t	m_chunkPages = 0;
+	uint32_t	m_lowWatermark = 0;
+	uint32_t	m_highWatermark = 0;
+
+	std::vector<Chunk>			m_chunks;
+	std::vector<virt_addr_t>	m_freePages;
+
+	ChunkCallback	m_chunkCallback;
+
+	PagePoolStats	m_stats;
+};
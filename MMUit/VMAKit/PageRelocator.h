@@ -13,6 +13,8 @@
 #include "TTEntry.h"
 #include "MMUConfig.h"
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -38,6 +40,14 @@ typedef struct
 	
 	// cpp object
 	void*				object;
+	
+	// fields below were added later and are kept at the end to preserve layout of the fields above
+	
+	bool				(*read_block)(virt_addr_t address, void* dst, size_t size);		// optional
+	bool				(*write_block)(virt_addr_t address, const void* src, size_t size);	// optional
+	
+	// cpp object (see pagerelocator_OpenJournal)
+	void*				journal;
 } pagerelocator;
 	
 typedef ttentry_t (*pagerelocator_callback)(TTLevel level, TTEntryDetails* oldEntry, TTEntryDetails* newEntry, uintptr_t user_data);
@@ -45,9 +55,21 @@ typedef ttentry_t (*pagerelocator_callback)(TTLevel level, TTEntryDetails* oldEn
 void		pagerelocator_Init(pagerelocator* relocator);
 bool		pagerelocator_RelocatePage(pagerelocator* relocator, virt_addr_t address, pagerelocator_callback callback);
 virt_addr_t	pagerelocator_PreparePageRelocation(pagerelocator* relocator, virt_addr_t address, pagerelocator_callback callback);
+bool		pagerelocator_RelocateRange(pagerelocator* relocator, virt_addr_t begin, virt_addr_t end, pagerelocator_callback callback);
 bool		pagerelocator_CompleteRelocation(pagerelocator* relocator);
+bool		pagerelocator_CompleteRelocations(pagerelocator* relocator);
 bool		pagerelocator_CancelRelocation(pagerelocator* relocator);
+bool		pagerelocator_CancelRelocations(pagerelocator* relocator);
 bool		pagerelocator_RestorePage(pagerelocator* relocator, virt_addr_t address);
+// chunk_pages of zero disables pool, alloc_in_physical_memory should support allocations of chunk size
+void		pagerelocator_EnablePagePool(pagerelocator* relocator, uint32_t chunk_pages, uint32_t low_watermark, uint32_t high_watermark);
+// with lazy copy ranges marked as written aren't copied into prepared page, the rest is copied on completion
+void		pagerelocator_SetLazyPageCopy(pagerelocator* relocator, bool lazy);
+bool		pagerelocator_MarkPageWritten(pagerelocator* relocator, virt_addr_t address, size_t size);
+// relocation state is recovered from existing journal (relocator should have no relocations yet) and changes are appended to it
+// on failure journal is not attached and relocator is left without relocations
+bool		pagerelocator_OpenJournal(pagerelocator* relocator, const char* path);
+bool		pagerelocator_FlushJournal(pagerelocator* relocator, bool sync);
 void		pagerelocator_Close(pagerelocator* relocator);
 	
 #ifdef __cplusplus
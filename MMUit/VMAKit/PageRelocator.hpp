@@ -9,54 +9,279 @@
 #pragma once
 
 #include "TTWalker.hpp"
+#include "AddressMap.hpp"
+#include "PagePool.hpp"
+#include "RelocationJournal.hpp"
 #include <algorithm>
-#include <map>
 #include <vector>
 
+template <typename PRIMITIVES>
+class RelocationTransaction;
+
+// Byte range of relocated page
+struct PageRange
+{
+	uint32_t	offset;
+	uint32_t	size;
+};
+
 template <typename PRIMITIVES>
 class PageRelocator : public PRIMITIVES
 {
+	friend class RelocationTransaction<PRIMITIVES>;
+	
 public:
 	
 	// Relocation callback is called when table translation entry is about to be updated
 	using RelocatorCallback = std::function<ttentry_t(TTLevel level, TTGenericEntry* oldEntry, TTGenericEntry* newEntry)>;
 	static const RelocatorCallback DefaultCallback;
 	
+	// Same as RelocatorCallback, but entries are passed as views (no entry objects are constructed for the call)
+	using RelocatorViewCallback = std::function<ttentry_t(TTLevel level, const TTDescriptorView* oldEntry, TTDescriptorView* newEntry)>;
+	static const RelocatorViewCallback DefaultViewCallback;
+	
+	// Number of relocated tables bookkeeping is preallocated for
+	static const uint32_t kDefaultRelocationCapacity = 64;
+	
+	// Number of ranges without original content tracked for pending page with lazy copy
+	static const uint32_t kMaxUncopiedRanges = 8;
+	
 public:
 	
 	PageRelocator() = delete;
 	
 	PageRelocator(MMUConfig mmuConfig, virt_addr_t tableBase)
 		: 	m_mmuConfig(mmuConfig), m_tableBase(tableBase),
-			kPageSize(uint32_t(mmuConfig.granule)), kPageMask(kPageSize - 1)
-	{}
+			kPageSize(uint32_t(mmuConfig.granule)), kPageMask(kPageSize - 1),
+			m_relocationMap(kDefaultRelocationCapacity), m_pagePool(*this, kPageSize)
+	{
+		initPagePool();
+	}
+	
+	// Relocator using copy of existing primitives (e.g. with mapped dumps or context)
+	PageRelocator(MMUConfig mmuConfig, virt_addr_t tableBase, const PRIMITIVES& primitives)
+		: 	PRIMITIVES(primitives), m_mmuConfig(mmuConfig), m_tableBase(tableBase),
+			kPageSize(uint32_t(mmuConfig.granule)), kPageMask(kPageSize - 1),
+			m_relocationMap(kDefaultRelocationCapacity), m_pagePool(*this, kPageSize)
+	{
+		initPagePool();
+	}
+	
+	PageRelocator(const PageRelocator&) = delete;
+	PageRelocator& operator=(const PageRelocator&) = delete;
+	
+	// Pages for table and page copies are carved from chunks of chunkPages pages allocated with primitives and
+	// recycled locally, so relocations rarely call allocInPhysicalMemory/deallocInPhysicalMemory.
+	// New chunk is allocated when less than lowWatermark pages are free, entirely free chunks are released
+	// once more than highWatermark pages are free. Primitives should support allocations of chunk size.
+	void enablePagePool(uint32_t chunkPages = PhysicalPagePool<PRIMITIVES>::kDefaultChunkPages,
+						uint32_t lowWatermark = PhysicalPagePool<PRIMITIVES>::kDefaultLowWatermark,
+						uint32_t highWatermark = PhysicalPagePool<PRIMITIVES>::kDefaultHighWatermark)
+	{
+		m_pagePool.configure(chunkPages, lowWatermark, highWatermark);
+	}
+	
+	// Pages allocated from pool are still returned to it, chunks are released once all their pages are free
+	void disablePagePool()
+	{
+		m_pagePool.configure(0, 0, 0);
+	}
+	
+	PagePoolStats getPagePoolStats()
+	{
+		return m_pagePool.getStats();
+	}
+	
+	// With lazy copy preparePageRelocationFor doesn't copy content of the page (tables are still copied), ranges which
+	// are going to be overwritten should be marked with markPageWritten before writing them and only the rest of the page
+	// is copied on completion (or by copyOriginalContent). Doesn't affect relocatePageFor and relocateRange.
+	void setLazyPageCopy(bool lazy)
+	{
+		m_lazyPageCopy = lazy;
+	}
+	
+	// Changes of relocation state are appended to journal (nullptr detaches it), journal should be attached
+	// before the first relocation (see writeJournalSnapshot otherwise) and flushed by owner
+	// Page pool chunks are journaled too (including ones released by destructor), so journal should outlive
+	// relocator or be detached before it is destroyed
+	void setJournal(RelocationJournal* journal)
+	{
+		m_journal = journal;
+	}
+	
+	// Rebuilds relocation state from journal of previous relocator for the same tables and attaches journal
+	// Relocator should have no relocations yet. Relocations which were pending are cancelled. Page pool chunks of
+	// previous relocator are adopted by page pool, so they are returned to primitives whole once all their pages are free.
+	// On failure relocator is left without relocations and journal.
+	bool recoverFromJournal(RelocationJournal& journal)
+	{
+		if (m_relocationMap.empty() == false || m_relocatedPages.empty() == false || m_pendingRelocations.empty() == false)
+			return false;
+		
+		std::vector<JournalRecord> records;
+		if (journal.load(records) == false)
+			return false;
+		
+		// records are replayed once in order they were written
+		AddressMap<virt_addr_t> pendingPages;	// target page VA -> allocated page VA
+		AddressMap<uint32_t> chunks;			// chunk VA -> pages
+		for (auto& record : records)
+		{
+			Relocation relocation = {
+				.originalEntry = record.originalEntry,
+				.allocatedPage = record.allocatedPage,
+				.entryAddress = record.entryAddress,
+				.refCount = record.refCount
+			};
+			
+			switch (record.type)
+			{
+				case JournalRecordType::Table:
+					m_relocationMap.insert(record.relocationPA) = relocation;
+					break;
+				case JournalRecordType::Reference:
+				{
+					Relocation* existingRelocation = m_relocationMap.find(record.relocationPA);
+					if (existingRelocation != nullptr)
+						existingRelocation->refCount = record.refCount;
+					break;
+				}
+				case JournalRecordType::Release:
+					m_relocationMap.erase(record.relocationPA);
+					break;
+				case JournalRecordType::Pending:
+					pendingPages.insert(record.targetPage) = record.allocatedPage;
+					break;
+				case JournalRecordType::Cancel:
+					pendingPages.erase(record.targetPage);
+					break;
+				case JournalRecordType::Page:
+					m_relocationMap.insert(record.relocationPA) = relocation;
+					m_relocatedPages.insert(record.targetPage) = record.allocatedPage;
+					pendingPages.erase(record.targetPage);
+					break;
+				case JournalRecordType::Restore:
+					m_relocatedPages.erase(record.targetPage);
+					break;
+				case JournalRecordType::Chunk:
+					chunks.insert(record.allocatedPage) = record.refCount;
+					break;
+				case JournalRecordType::ChunkRelease:
+					chunks.erase(record.allocatedPage);
+					break;
+					
+				default:
+					// unknown record, journal is not usable
+					clearRelocationState();
+					return false;
+			}
+		}
+		
+		m_journal = &journal;
+		
+		// pages of chunks which are not used by relocations (including pending ones) are free
+		AddressMap<bool> usedPages;
+		m_relocationMap.forEach([&usedPages] (phys_addr_t, Relocation& relocation) {
+			usedPages.insert(relocation.allocatedPage) = true;
+		});
+		pendingPages.forEach([&usedPages] (virt_addr_t, virt_addr_t allocatedPage) {
+			usedPages.insert(allocatedPage) = true;
+		});
+		
+		bool result = true;
+		chunks.forEach([this, &usedPages, &result] (virt_addr_t address, uint32_t pages) {
+			result &= m_pagePool.adoptChunk(address, pages);
+			for (uint32_t page = 0; page < pages; page++)
+			{
+				if (usedPages.contains(address + page * kPageSize) == false)
+					m_pagePool.freePage(address + page * kPageSize);
+			}
+		});
+		
+		// tables are still referenced by relocations which were never completed
+		m_pendingPages.clear();
+		pendingPages.forEach([this] (virt_addr_t targetPageAddress, virt_addr_t allocatedPage) {
+			m_pagePool.freePage(allocatedPage);
+			m_pendingPages.push_back(targetPageAddress);
+		});
+		
+		for (auto targetPageAddress : m_pendingPages)
+		{
+			logJournal(JournalRecordType::Cancel, kInvalidAddress, nullptr, targetPageAddress);
+			result &= restoreTablesFor(targetPageAddress);
+		}
+		
+		// partially rebuilt state doesn't match tables, so it is dropped rather than used without journal
+		if (result == false)
+			clearRelocationState();
+		
+		return result;
+	}
+	
+	// Writes records describing current relocation state to empty journal, flushes and attaches it
+	// Journal is compacted by writing snapshot to new file which then replaces the old one
+	bool writeJournalSnapshot(RelocationJournal& journal)
+	{
+		RelocationJournal* previousJournal = m_journal;
+		m_journal = &journal;
+		
+		m_pagePool.forEachChunk([this] (virt_addr_t address, uint32_t pages) {
+			logJournalChunk(JournalRecordType::Chunk, address, pages);
+		});
+		m_relocationMap.forEach([this] (phys_addr_t relocationPA, Relocation& relocation) {
+			logJournal(JournalRecordType::Table, relocationPA, &relocation, kInvalidAddress);
+		});
+		m_relocatedPages.forEach([this] (virt_addr_t targetPageAddress, virt_addr_t allocatedPage) {
+			phys_addr_t relocationPA = this->virtualToPhysical(allocatedPage);
+			logJournal(JournalRecordType::Page, relocationPA, m_relocationMap.find(relocationPA), targetPageAddress);
+		});
+		m_pendingRelocations.forEach([this] (virt_addr_t targetPageAddress, StagingInfo& stagingInfo) {
+			logJournal(JournalRecordType::Pending, stagingInfo.allocatedPagePA, &stagingInfo.relocation, targetPageAddress);
+		});
+		
+		if (journal.flush(true) == false)
+		{
+			m_journal = previousJournal;
+			return false;
+		}
+		
+		return true;
+	}
+	
+	// Preallocates bookkeeping for pageCount relocated pages, so relocations don't allocate memory until it is exceeded
+	void reserveRelocations(size_t pageCount)
+	{
+		m_relocatedPages.reserve(pageCount);
+		
+		// every relocated page owns a leaf table and shares tables of upper levels
+		m_relocationMap.reserve(std::max<size_t>(pageCount, kDefaultRelocationCapacity));
+	}
 
 	bool isPageRelocatedFor(virt_addr_t address)
 	{
 		virt_addr_t targetPageAddress = address & ~kPageMask;
 		
-		if (std::find(m_relocatedPages.begin(), m_relocatedPages.end(), targetPageAddress) != m_relocatedPages.end())
-			return true;
-		else
-			return false;
+		return m_relocatedPages.contains(targetPageAddress);
 	}
 	
 	bool isRelocationPendingFor(virt_addr_t address)
 	{
-		// check if there is a pending relocation
-		if (m_relocationPending == false)
-			return false;
-
 		virt_addr_t targetPageAddress = address & ~kPageMask;
 		
-		// check if target page matches one in pending relocation
-		if (m_stagingInfo.targetPageVA != targetPageAddress)
-			return false;
-		else
-			return true;
+		return m_pendingRelocations.contains(targetPageAddress);
+	}
+	
+	size_t getPendingRelocationCount()
+	{
+		return m_pendingRelocations.size();
+	}
+	
+	bool relocatePageFor(virt_addr_t address, RelocatorCallback callback)
+	{
+		return relocatePageFor(address, wrapCallback(callback));
 	}
 	
-	bool relocatePageFor(virt_addr_t address, RelocatorCallback callback = DefaultCallback)
+	bool relocatePageFor(virt_addr_t address, RelocatorViewCallback callback = DefaultViewCallback)
 	{
 		virt_addr_t page = preparePageRelocationFor(address, callback);
 		if (page == kInvalidAddress)
@@ -65,62 +290,63 @@ public:
 		return completeRelocation();
 	}
 	
-	virt_addr_t preparePageRelocationFor(virt_addr_t address, RelocatorCallback callback = DefaultCallback)
+	virt_addr_t preparePageRelocationFor(virt_addr_t address, RelocatorCallback callback)
+	{
+		return preparePageRelocationFor(address, wrapCallback(callback));
+	}
+	
+	// Relocates tables on the path to the page and returns VA of page copy, leaf entry is updated on completion
+	// Relocations of multiple pages can be pending at once, preparing the same page again cancels its previous relocation
+	// Block on the path is split into table of next level entries, so only the target granule is relocated
+	virt_addr_t preparePageRelocationFor(virt_addr_t address, RelocatorViewCallback callback = DefaultViewCallback)
 	{
 		virt_addr_t targetPageAddress = address & ~kPageMask;
 		
-		if (std::find(m_relocatedPages.begin(), m_relocatedPages.end(), targetPageAddress) != m_relocatedPages.end())
+		if (m_relocatedPages.contains(targetPageAddress))
 			return false;
 
-		// cancel pending relocations
-		cancelRelocation();
+		// cancel pending relocation of the same page
+		cancelRelocationFor(targetPageAddress);
 		
-		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase);
-		WalkResult result = walker.walkTo(address, [this, callback] (WalkPosition* position, TTGenericEntry* entry) {
+		StagingInfo stagingInfo;
+		
+		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase, *this);
+		WalkResult result = walker.walkViewTo(address, [this, &callback, &stagingInfo] (WalkPosition* position, TTDescriptorView* entry) {
 			// safety checks
 			if (position == nullptr || entry == nullptr)
 				return WalkOperation::Stop;
 			
-			// get next level page
-			virt_addr_t nextLevelPA = entry->getOutputAddress();
+			bool splitBlock = entry->isBlockDescriptor();
+			
+			// level can't hold blocks (e.g. 16K and 64K L1), such entry can't be split
+			if (splitBlock && HasBlockDescriptors(m_mmuConfig.granule, position->level) == false)
+				return WalkOperation::Stop;
 			
-			// check if page is already relocated
-			if (m_relocationMap.find(nextLevelPA) != m_relocationMap.end())
+			if (splitBlock == false)
 			{
-				m_relocationMap[nextLevelPA].refCount++;
-				return WalkOperation::Continue;
+				// get next level page
+				virt_addr_t nextLevelPA = entry->getOutputAddress();
+				
+				// check if page is already relocated
+				Relocation* existingRelocation = m_relocationMap.find(nextLevelPA);
+				if (existingRelocation != nullptr)
+				{
+					existingRelocation->refCount++;
+					logUndo(UndoType::Reference, kInvalidAddress, nextLevelPA, 0);
+					logJournal(JournalRecordType::Reference, nextLevelPA, existingRelocation, kInvalidAddress);
+					return WalkOperation::Continue;
+				}
 			}
 			
-			// allocate new page
-			virt_addr_t newPageVA = this->allocInPhysicalMemory(kPageSize);
-			assert((newPageVA & kPageMask) == 0);
-			
-			virt_addr_t nextLevelVA = this->physicalToVirtual(nextLevelPA);
-			
-			// clone page content
-			this->copyInKernel(newPageVA, nextLevelVA, kPageSize);
-			
-			// get PA of allocated page
-			phys_addr_t newPagePA = this->virtualToPhysical(newPageVA);
-			
-			// save original descriptor for current level
-			ttentry_t oldEntryDescriptor = entry->getDescriptor();
+			phys_addr_t originalPA = entry->getOutputAddress();
+			bool lazyCopy = m_lazyPageCopy && entry->isPageDescriptor();
 			
-			ttentry_t newEntryDescriptor;
-			TTGenericEntry* oldEntry = entry->clone();
-			
-			// update entry PA
-			entry->setOutputAddress(newPagePA);
-			
-			// apply external modifications
-			newEntryDescriptor = callback(position->level, oldEntry, entry);
-			delete oldEntry;
-
-			Relocation relocation = {
-				.originalEntry = oldEntryDescriptor,
-				.allocatedPage = newPageVA,
-				.refCount = 1
-			};
+			// split table is tracked as relocated one, so restore writes original block back
+			Relocation relocation;
+			phys_addr_t newPagePA;
+			ttentry_t newEntryDescriptor = (splitBlock)?	splitBlockFor(position->level, entry, callback, &relocation, &newPagePA) :
+															clonePageFor(position->level, entry, callback, &relocation, &newPagePA, lazyCopy == false);
+			relocation.entryAddress = position->tableAddress + position->entryOffset;
 
 			if (entry->isPageDescriptor() == false)
 			{
@@ -128,15 +354,22 @@ public:
 				this->writeAddress(position->tableAddress + position->entryOffset, newEntryDescriptor);
 				
 				// save relocated page
-				m_relocationMap[newPagePA] = relocation;
+				m_relocationMap.insert(newPagePA) = relocation;
+				logUndo(UndoType::Table, position->tableAddress + position->entryOffset, newPagePA, relocation.originalEntry);
+				logJournal(JournalRecordType::Table, newPagePA, &relocation, kInvalidAddress);
 			}
 			else
 			{
 				// stage relocation
-				m_stagingInfo.allocatedPagePA = newPagePA;
-				m_stagingInfo.allocatedPageEntry = newEntryDescriptor;
-				m_stagingInfo.entryPosition = *position;
-				m_stagingInfo.relocation = relocation;
+				stagingInfo.allocatedPagePA = newPagePA;
+				stagingInfo.allocatedPageEntry = newEntryDescriptor;
+				stagingInfo.entryPosition = *position;
+				stagingInfo.relocation = relocation;
+				stagingInfo.originalPagePA = originalPA;
+				
+				// the whole page is copied on completion unless marked as written
+				stagingInfo.uncopiedRangeCount = (lazyCopy)? 1 : 0;
+				stagingInfo.uncopiedRanges[0] = { 0, kPageSize };
 			}
 			
 			return WalkOperation::Continue;
@@ -144,50 +377,209 @@ public:
 		
 		if (result.getType() == WalkResultType::Complete)
 		{
-			m_stagingInfo.targetPageVA = targetPageAddress;
-			m_relocationPending = true;
+			m_pendingRelocations.insert(targetPageAddress) = stagingInfo;
+			m_lastPendingPage = targetPageAddress;
+			logUndo(UndoType::PendingPage, targetPageAddress, stagingInfo.allocatedPagePA, 0);
+			logJournal(JournalRecordType::Pending, stagingInfo.allocatedPagePA, &stagingInfo.relocation, targetPageAddress);
 			
-			return m_stagingInfo.relocation.allocatedPage;
+			return stagingInfo.relocation.allocatedPage;
 		}
 		else
 		{
-			restorePageFor(targetPageAddress);
+			// transaction reverts the path with its undo log, otherwise tables would be released twice
+			if (m_undoLog == nullptr)
+				restoreTablesFor(targetPageAddress);
 			
 			return kInvalidAddress;
 		}
 	}
 
-	bool completeRelocation()
+	bool relocateRange(virt_addr_t begin, virt_addr_t end, RelocatorCallback callback)
 	{
-		if (m_relocationPending == false)
+		return relocateRange(begin, end, wrapCallback(callback));
+	}
+	
+	// Relocates every page in [begin, end), result is the same as calling relocatePageFor for each page
+	// Upper levels are walked once per leaf table, every table is cloned at most once and leaf entries
+	// of each table are read and written with single block operation (if supported by primitives)
+	// All pages of the range should be mapped by page descriptors and not relocated (or pending) yet, otherwise nothing is changed
+	bool relocateRange(virt_addr_t begin, virt_addr_t end, RelocatorViewCallback callback = DefaultViewCallback)
+	{
+		if (begin >= end)
 			return false;
 		
-		// write TT entry back
-		this->writeAddress(m_stagingInfo.entryPosition.tableAddress + m_stagingInfo.entryPosition.entryOffset, m_stagingInfo.allocatedPageEntry);
+		virt_addr_t firstPage = begin & ~kPageMask;
+		uint32_t granuleShift = GetGranuleShift(m_mmuConfig.granule);
+		uint64_t pageCount = ((end - 1 - firstPage) >> granuleShift) + 1;
 		
-		// save relocated page
-		m_relocationMap[m_stagingInfo.allocatedPagePA] = m_stagingInfo.relocation;
+		if (isRangeRelocatable(firstPage, end, pageCount) == false)
+			return false;
+		
+		uint32_t tableEntries = kPageSize / kPlatformAddressSize;
+		
+		for (uint64_t page = 0; page < pageCount; )
+		{
+			virt_addr_t pageAddress = firstPage + (page << granuleShift);
+			
+			// pages up to the end of range or leaf table
+			uint32_t firstIndex = uint32_t(pageAddress >> granuleShift) & (tableEntries - 1);
+			uint32_t count = uint32_t(std::min<uint64_t>(pageCount - page, tableEntries - firstIndex));
+			
+			virt_addr_t leafTable = relocateTablesFor(pageAddress, count, callback);
+			if (leafTable == kInvalidAddress)
+				return false;
+			
+			relocateLeafEntries(pageAddress, leafTable, firstIndex, count, callback);
+			
+			page += count;
+		}
+		
+		return true;
+	}
 
-		// add page to relocated pages
-		m_relocatedPages.push_back(m_stagingInfo.targetPageVA);
+	// Excludes size bytes from address from original content copied into pending page
+	bool markPageWritten(virt_addr_t address, size_t size)
+	{
+		StagingInfo* stagingInfo = m_pendingRelocations.find(address & ~kPageMask);
+		if (stagingInfo == nullptr)
+			return false;
+		
+		uint32_t begin = uint32_t(address & kPageMask);
+		uint32_t end = uint32_t(std::min<uint64_t>(uint64_t(begin) + size, kPageSize));
+		
+		PageRange ranges[kMaxUncopiedRanges];
+		uint32_t count = 0;
+		
+		for (uint32_t i = 0; i < stagingInfo->uncopiedRangeCount; i++)
+		{
+			PageRange range = stagingInfo->uncopiedRanges[i];
+			uint32_t rangeEnd = range.offset + range.size;
+			
+			if (rangeEnd <= begin || range.offset >= end)
+			{
+				ranges[count++] = range;
+				continue;
+			}
+			
+			bool head = range.offset < begin;
+			bool tail = rangeEnd > end;
+			
+			// no space to split the range, so it is copied now (marked part is written later)
+			if (head && tail && stagingInfo->uncopiedRangeCount == kMaxUncopiedRanges)
+			{
+				copyOriginalRange(*stagingInfo, range);
+				continue;
+			}
+			
+			if (head)
+				ranges[count++] = { range.offset, begin - range.offset };
+			if (tail)
+				ranges[count++] = { end, rangeEnd - end };
+		}
 		
-		m_relocationPending = false;
+		std::copy(ranges, ranges + count, stagingInfo->uncopiedRanges);
+		stagingInfo->uncopiedRangeCount = count;
 		
 		return true;
 	}
 	
+	// Returns number of ranges of pending page which still need original content, up to count of them are stored to ranges
+	size_t getOriginalContentRanges(virt_addr_t address, PageRange* ranges, size_t count)
+	{
+		StagingInfo* stagingInfo = m_pendingRelocations.find(address & ~kPageMask);
+		if (stagingInfo == nullptr)
+			return 0;
+		
+		if (ranges != nullptr)
+			std::copy(stagingInfo->uncopiedRanges, stagingInfo->uncopiedRanges + std::min<size_t>(count, stagingInfo->uncopiedRangeCount), ranges);
+		
+		return stagingInfo->uncopiedRangeCount;
+	}
+	
+	// Copies original content which wasn't copied yet into pending page
+	bool copyOriginalContent(virt_addr_t address)
+	{
+		StagingInfo* stagingInfo = m_pendingRelocations.find(address & ~kPageMask);
+		if (stagingInfo == nullptr)
+			return false;
+		
+		copyOriginalRanges(*stagingInfo);
+		stagingInfo->uncopiedRangeCount = 0;
+		
+		return true;
+	}
+	
+	// Completes relocation prepared last
+	bool completeRelocation()
+	{
+		return completeRelocationFor(m_lastPendingPage);
+	}
+	
+	bool completeRelocationFor(virt_addr_t address)
+	{
+		virt_addr_t targetPageAddress = address & ~kPageMask;
+		
+		StagingInfo* stagingInfo = m_pendingRelocations.find(targetPageAddress);
+		if (stagingInfo == nullptr)
+			return false;
+		
+		commitStagingInfo(targetPageAddress, *stagingInfo);
+		m_pendingRelocations.erase(targetPageAddress);
+		
+		return true;
+	}
+	
+	// Completes all pending relocations, returns false if there were none
+	bool completeRelocations()
+	{
+		if (m_pendingRelocations.empty())
+			return false;
+		
+		m_pendingRelocations.forEach([this] (virt_addr_t targetPageAddress, StagingInfo& stagingInfo) {
+			commitStagingInfo(targetPageAddress, stagingInfo);
+		});
+		m_pendingRelocations.clear();
+		
+		return true;
+	}
+	
+	// Cancels relocation prepared last
 	bool cancelRelocation()
 	{
-		if (m_relocationPending == false)
+		return cancelRelocationFor(m_lastPendingPage);
+	}
+	
+	bool cancelRelocationFor(virt_addr_t address)
+	{
+		virt_addr_t targetPageAddress = address & ~kPageMask;
+		
+		StagingInfo* stagingInfo = m_pendingRelocations.find(targetPageAddress);
+		if (stagingInfo == nullptr)
 			return false;
 		
 		// deallocate page
-		this->deallocInPhysicalMemory(m_stagingInfo.relocation.allocatedPage, kPageSize);
+		m_pagePool.freePage(stagingInfo->relocation.allocatedPage);
+		m_pendingRelocations.erase(targetPageAddress);
+		logJournal(JournalRecordType::Cancel, kInvalidAddress, nullptr, targetPageAddress);
 		
 		// restore TT entries
-		bool result = restorePageFor(m_stagingInfo.targetPageVA);
+		return restoreTablesFor(targetPageAddress);
+	}
+	
+	// Cancels all pending relocations, returns false if there were none or some of them failed
+	bool cancelRelocations()
+	{
+		if (m_pendingRelocations.empty())
+			return false;
+		
+		m_pendingPages.clear();
+		m_pendingRelocations.forEach([this] (virt_addr_t targetPageAddress, StagingInfo&) {
+			m_pendingPages.push_back(targetPageAddress);
+		});
 		
-		m_relocationPending = false;
+		bool result = true;
+		for (auto targetPageAddress : m_pendingPages)
+			result &= cancelRelocationFor(targetPageAddress);
 		
 		return result;
 	}
@@ -196,58 +588,413 @@ public:
 	{
 		virt_addr_t targetPageAddress = address & ~kPageMask;
 		
-		if (std::find(m_relocatedPages.begin(), m_relocatedPages.end(), targetPageAddress) == m_relocatedPages.end())
+		// pending relocation is cancelled
+		if (m_pendingRelocations.contains(targetPageAddress))
+			return cancelRelocationFor(targetPageAddress);
+		
+		if (m_relocatedPages.contains(targetPageAddress) == false)
+			return false;
+		
+		bool result = restoreTablesFor(targetPageAddress);
+		
+		// remove page from relocated pages
+		m_relocatedPages.erase(targetPageAddress);
+		logJournal(JournalRecordType::Restore, kInvalidAddress, nullptr, targetPageAddress);
+		
+		return result;
+	}
+	
+private:
+	
+	struct Relocation;
+	struct StagingInfo;
+	
+	// TTGenericEntry callbacks get entries constructed from views, changes made to new entry are copied back to its view
+	static RelocatorViewCallback wrapCallback(RelocatorCallback& callback)
+	{
+		return [&callback] (TTLevel level, const TTDescriptorView* oldEntry, TTDescriptorView* newEntry) -> ttentry_t
 		{
-			// unable to find page, check if there is a pending relocation
-			if (m_relocationPending == false)
-				return false;
+			TTEntrySnapshot oldSnapshot(*oldEntry);
+			TTEntrySnapshot newSnapshot(*newEntry);
 			
-			// check if target page matches one in pending relocation
-			if (m_stagingInfo.targetPageVA != targetPageAddress)
-				return false;
+			ttentry_t descriptor = callback(level, oldSnapshot.get(), newSnapshot.get());
+			newEntry->setDescriptor(newSnapshot->getDescriptor());
+			
+			return descriptor;
+		};
+	}
+	
+	// Allocates copy of the table or page entry points to and redirects entry to it
+	// Returns descriptor produced by callback, original descriptor and allocated page are saved to relocation
+	ttentry_t clonePageFor(TTLevel level, TTDescriptorView* entry, RelocatorViewCallback& callback, Relocation* relocation, phys_addr_t* newPagePA, bool copyContent = true)
+	{
+		// allocate new page
+		virt_addr_t newPageVA = m_pagePool.allocPage();
+		assert((newPageVA & kPageMask) == 0);
+		
+		// clone page content
+		if (copyContent)
+			this->copyInKernel(newPageVA, this->physicalToVirtual(entry->getOutputAddress()), kPageSize);
+		
+		// get PA of allocated page
+		*newPagePA = this->virtualToPhysical(newPageVA);
+		
+		// save original descriptor for current level
+		relocation->originalEntry = entry->getDescriptor();
+		relocation->allocatedPage = newPageVA;
+		relocation->refCount = 1;
+		
+		TTDescriptorView oldEntry = *entry;
+		
+		// update entry PA
+		entry->setOutputAddress(*newPagePA);
+		
+		// apply external modifications
+		return callback(level, &oldEntry, entry);
+	}
+	
+	// Allocates table of next level entries mapping the same range as block entry and redirects entry to it
+	// Entries keep block attributes (except contiguous hint), so translation is the same until a page of it is relocated
+	// Returns table descriptor produced by callback, original block descriptor and allocated table are saved to relocation
+	ttentry_t splitBlockFor(TTLevel level, TTDescriptorView* entry, RelocatorViewCallback& callback, Relocation* relocation, phys_addr_t* newTablePA)
+	{
+		// allocate new table
+		virt_addr_t newTableVA = m_pagePool.allocPage();
+		assert((newTableVA & kPageMask) == 0);
+		
+		buildSplitEntries(level, entry->getDescriptor(), entry->getOutputAddress());
+		
+		// fill table
+		if (this->writeBlock(newTableVA, m_leafEntries.data(), kPageSize) == false)
+		{
+			for (uint32_t i = 0; i < m_leafEntries.size(); i++)
+				this->writeAddress(newTableVA + i * kPlatformAddressSize, m_leafEntries[i]);
+		}
+		
+		// get PA of allocated table
+		*newTablePA = this->virtualToPhysical(newTableVA);
+		
+		// save original block descriptor
+		relocation->originalEntry = entry->getDescriptor();
+		relocation->allocatedPage = newTableVA;
+		relocation->refCount = 1;
+		
+		TTDescriptorView oldEntry = *entry;
+		
+		// turn block into table descriptor
+		entry->setDescriptor(kTTDescriptorTableBit | kTTDescriptorValidBit);
+		entry->setOutputAddress(*newTablePA);
+		
+		// apply external modifications
+		return callback(level, &oldEntry, entry);
+	}
+	
+	// Fills m_leafEntries with entries of the level below block level covering block range
+	void buildSplitEntries(TTLevel level, ttentry_t blockDescriptor, phys_addr_t blockAddress)
+	{
+		assert(HasBlockDescriptors(m_mmuConfig.granule, level));
+		
+		TTLevel entryLevel = level;
+		entryLevel++;
+		
+		uint32_t tableEntries = kPageSize / kPlatformAddressSize;
+		phys_addr_t entrySize = phys_addr_t(1) << GetLevelShift(m_mmuConfig.granule, entryLevel);
+		
+		// blocks and pages share attribute fields, contiguous hint would be wrong once one of entries is changed
+		ttentry_t attributes = blockDescriptor & kTTDescriptorAttributesMask & ~kTTDescriptorContiguousBit;
+		ttentry_t type = (entryLevel == TTLevel::Level3)? (kTTDescriptorTableBit | kTTDescriptorValidBit) : kTTDescriptorValidBit;
+		
+		m_leafEntries.resize(tableEntries);
+		for (uint32_t i = 0; i < tableEntries; i++)
+		{
+			TTDescriptorView entry(m_mmuConfig.granule, entryLevel, attributes | type);
+			entry.setOutputAddress(blockAddress + i * entrySize);
+			m_leafEntries[i] = entry.getDescriptor();
 		}
+	}
+	
+	void copyOriginalRange(const StagingInfo& stagingInfo, PageRange range)
+	{
+		this->copyInKernel(stagingInfo.relocation.allocatedPage + range.offset, this->physicalToVirtual(stagingInfo.originalPagePA) + range.offset, range.size);
+	}
+	
+	void copyOriginalRanges(const StagingInfo& stagingInfo)
+	{
+		for (uint32_t i = 0; i < stagingInfo.uncopiedRangeCount; i++)
+			copyOriginalRange(stagingInfo, stagingInfo.uncopiedRanges[i]);
+	}
+	
+	// Writes staged leaf entry and moves page to relocated pages
+	void commitStagingInfo(virt_addr_t targetPageAddress, const StagingInfo& stagingInfo)
+	{
+		// finish lazy copy before page is mapped
+		copyOriginalRanges(stagingInfo);
+		
+		// write TT entry back
+		this->writeAddress(stagingInfo.entryPosition.tableAddress + stagingInfo.entryPosition.entryOffset, stagingInfo.allocatedPageEntry);
+		
+		registerRelocatedPage(targetPageAddress, stagingInfo);
+	}
+	
+	void registerRelocatedPage(virt_addr_t targetPageAddress, const StagingInfo& stagingInfo)
+	{
+		// save relocated page
+		m_relocationMap.insert(stagingInfo.allocatedPagePA) = stagingInfo.relocation;
 		
-		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase);
+		// add page to relocated pages
+		m_relocatedPages.insert(targetPageAddress) = stagingInfo.relocation.allocatedPage;
+		logJournal(JournalRecordType::Page, stagingInfo.allocatedPagePA, &stagingInfo.relocation, targetPageAddress);
+	}
+	
+	// Releases tables relocated for the page, restoring original entries of tables which are not used by other pages
+	bool restoreTablesFor(virt_addr_t address)
+	{
+		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase, *this);
 		
-		bool result = walker.reverseWalkFrom(address, [this] (WalkPosition* position, TTGenericEntry* entry) {
+		return walker.reverseWalkViewFrom(address, [this] (WalkPosition* position, TTDescriptorView* entry) {
 			// safety checks
 			if (position == nullptr || entry == nullptr)
 				return WalkOperation::Stop;
 			
 			// get level page
 			virt_addr_t levelPA = entry->getOutputAddress();
-			if (m_relocationMap.find(levelPA) == m_relocationMap.end())
-				return WalkOperation::Continue;
 			
 			// get original descriptor
-			Relocation& relocation = m_relocationMap[levelPA];
+			Relocation* relocation = m_relocationMap.find(levelPA);
+			if (relocation == nullptr)
+				return WalkOperation::Continue;
 
-			if (relocation.refCount == 1)
+			if (relocation->refCount == 1)
 			{
 				// restore TT entry
-				this->writeAddress(position->tableAddress + position->entryOffset, relocation.originalEntry);
+				this->writeAddress(position->tableAddress + position->entryOffset, relocation->originalEntry);
 
 				// deallocate page
-				this->deallocInPhysicalMemory(relocation.allocatedPage, kPageSize);
+				m_pagePool.freePage(relocation->allocatedPage);
 
 				// remove page from relocation map
+				logJournal(JournalRecordType::Release, levelPA, relocation, kInvalidAddress);
 				m_relocationMap.erase(levelPA);
 			}
 			else
 			{
-				relocation.refCount--;
+				relocation->refCount--;
+				logJournal(JournalRecordType::Reference, levelPA, relocation, kInvalidAddress);
 			}
 			
 			return WalkOperation::Continue;
 		});
-
-		if (m_relocationPending == false)
+	}
+	
+	// Undo log is recorded while transaction prepares relocations
+	enum class UndoType {
+		Table,			// table was cloned and entry at address redirected to it
+		Reference,		// existing relocated table was referenced once more
+		PendingPage		// page at address was staged for relocation
+	};
+	
+	struct UndoRecord
+	{
+		UndoType	type;
+		virt_addr_t	address;		// entry VA or target page VA
+		phys_addr_t	relocationPA;	// PA of relocated table or page
+		ttentry_t	originalEntry;
+	};
+	
+	void logUndo(UndoType type, virt_addr_t address, phys_addr_t relocationPA, ttentry_t originalEntry)
+	{
+		if (m_undoLog != nullptr)
+			m_undoLog->push_back({ type, address, relocationPA, originalEntry });
+	}
+	
+	void logJournal(JournalRecordType type, phys_addr_t relocationPA, const Relocation* relocation, virt_addr_t targetPage)
+	{
+		if (m_journal == nullptr)
+			return;
+		
+		JournalRecord record = {
+			.type = type,
+			.refCount = (relocation)? relocation->refCount : 0,
+			.relocationPA = relocationPA,
+			.entryAddress = (relocation)? relocation->entryAddress : kInvalidAddress,
+			.originalEntry = (relocation)? relocation->originalEntry : 0,
+			.allocatedPage = (relocation)? relocation->allocatedPage : kInvalidAddress,
+			.targetPage = targetPage
+		};
+		m_journal->append(record);
+	}
+	
+	void logJournalChunk(JournalRecordType type, virt_addr_t address, uint32_t pages)
+	{
+		Relocation chunk = {
+			.originalEntry = 0,
+			.allocatedPage = address,
+			.entryAddress = kInvalidAddress,
+			.refCount = pages
+		};
+		logJournal(type, kInvalidAddress, &chunk, kInvalidAddress);
+	}
+	
+	// Chunks are journaled, so recovered relocator can return them whole
+	void initPagePool()
+	{
+		m_pagePool.setChunkCallback([this] (virt_addr_t address, uint32_t pages, bool allocated) {
+			logJournalChunk((allocated)? JournalRecordType::Chunk : JournalRecordType::ChunkRelease, address, pages);
+		});
+	}
+	
+	// Forgets all relocations and detaches journal, tables and pages are not changed
+	void clearRelocationState()
+	{
+		m_relocationMap.clear();
+		m_relocatedPages.clear();
+		m_pendingRelocations.clear();
+		m_lastPendingPage = kInvalidAddress;
+		m_journal = nullptr;
+	}
+	
+	// Reverts records in reverse order, tables still used by other pages only lose a reference
+	void rollbackUndoLog(std::vector<UndoRecord>& undoLog)
+	{
+		for (auto record = undoLog.rbegin(); record != undoLog.rend(); record++)
 		{
-			// remove page from relocated pages
-			m_relocatedPages.erase(std::remove(m_relocatedPages.begin(), m_relocatedPages.end(), targetPageAddress), m_relocatedPages.end());
+			switch (record->type)
+			{
+				case UndoType::PendingPage:
+				{
+					// relocation could be completed or cancelled outside of transaction
+					StagingInfo* stagingInfo = m_pendingRelocations.find(record->address);
+					if (stagingInfo == nullptr || stagingInfo->allocatedPagePA != record->relocationPA)
+						break;
+					
+					m_pagePool.freePage(stagingInfo->relocation.allocatedPage);
+					m_pendingRelocations.erase(record->address);
+					logJournal(JournalRecordType::Cancel, kInvalidAddress, nullptr, record->address);
+					break;
+				}
+				case UndoType::Reference:
+				case UndoType::Table:
+				{
+					Relocation* relocation = m_relocationMap.find(record->relocationPA);
+					assert(relocation != nullptr);
+					
+					if (relocation->refCount > 1)
+					{
+						relocation->refCount--;
+						logJournal(JournalRecordType::Reference, record->relocationPA, relocation, kInvalidAddress);
+						break;
+					}
+					
+					// last reference is always the one which cloned the table
+					assert(record->type == UndoType::Table);
+					this->writeAddress(record->address, record->originalEntry);
+					m_pagePool.freePage(relocation->allocatedPage);
+					logJournal(JournalRecordType::Release, record->relocationPA, relocation, kInvalidAddress);
+					m_relocationMap.erase(record->relocationPA);
+					break;
+				}
+			}
 		}
 		
-		return result;
+		undoLog.clear();
+	}
+	
+	// Checks that pageCount pages from firstPage are mapped with page descriptors and none of them is relocated or pending
+	bool isRangeRelocatable(virt_addr_t firstPage, virt_addr_t end, uint64_t pageCount)
+	{
+		uint64_t mappedPages = 0;
+		
+		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase, *this);
+		bool result = walker.enumerateMappings(firstPage, end, [this, &mappedPages] (const TranslationMapping& mapping) -> WalkOperation {
+			if (mapping.level != TTLevel::Level3 || m_relocatedPages.contains(mapping.virtualAddress) || m_pendingRelocations.contains(mapping.virtualAddress))
+				return WalkOperation::Stop;
+			
+			mappedPages++;
+			return WalkOperation::Continue;
+		});
+		
+		return result && mappedPages == pageCount;
+	}
+	
+	// Relocates tables on the path to address accounting pageCount pages sharing them, returns VA of leaf table
+	virt_addr_t relocateTablesFor(virt_addr_t address, uint32_t pageCount, RelocatorViewCallback& callback)
+	{
+		virt_addr_t leafTable = kInvalidAddress;
+		
+		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase, *this);
+		walker.walkViewTo(address, [this, pageCount, &callback, &leafTable] (WalkPosition* position, TTDescriptorView* entry) {
+			// leaf entries are relocated separately
+			if (position->level == TTLevel::Level3)
+			{
+				leafTable = position->tableAddress;
+				return WalkOperation::Stop;
+			}
+			
+			if (entry->isTableDescriptor() == false)
+				return WalkOperation::Stop;
+			
+			// table can be already relocated for other pages
+			Relocation* existingRelocation = m_relocationMap.find(entry->getOutputAddress());
+			if (existingRelocation != nullptr)
+			{
+				existingRelocation->refCount += pageCount;
+				logJournal(JournalRecordType::Reference, entry->getOutputAddress(), existingRelocation, kInvalidAddress);
+				return WalkOperation::Continue;
+			}
+			
+			Relocation relocation;
+			phys_addr_t newTablePA;
+			ttentry_t newEntryDescriptor = clonePageFor(position->level, entry, callback, &relocation, &newTablePA);
+			relocation.entryAddress = position->tableAddress + position->entryOffset;
+			relocation.refCount = pageCount;
+			
+			// write TT entry back
+			this->writeAddress(position->tableAddress + position->entryOffset, newEntryDescriptor);
+			
+			// save relocated table
+			m_relocationMap.insert(newTablePA) = relocation;
+			logJournal(JournalRecordType::Table, newTablePA, &relocation, kInvalidAddress);
+			
+			return WalkOperation::Continue;
+		});
+		
+		return leafTable;
+	}
+	
+	// Relocates count pages mapped by consecutive entries of leaf table starting at firstIndex
+	void relocateLeafEntries(virt_addr_t pageAddress, virt_addr_t leafTable, uint32_t firstIndex, uint32_t count, RelocatorViewCallback& callback)
+	{
+		virt_addr_t entriesAddress = leafTable + firstIndex * kPlatformAddressSize;
+		
+		m_leafEntries.resize(count);
+		ttentry_t* entries = m_leafEntries.data();
+		
+		if (this->readBlock(entriesAddress, entries, count * kPlatformAddressSize) == false)
+		{
+			for (uint32_t i = 0; i < count; i++)
+				entries[i] = this->readAddress(entriesAddress + i * kPlatformAddressSize);
+		}
+		
+		for (uint32_t i = 0; i < count; i++)
+		{
+			TTDescriptorView entry(m_mmuConfig.granule, TTLevel::Level3, entries[i]);
+			
+			Relocation relocation;
+			phys_addr_t newPagePA;
+			entries[i] = clonePageFor(TTLevel::Level3, &entry, callback, &relocation, &newPagePA);
+			relocation.entryAddress = entriesAddress + i * kPlatformAddressSize;
+			
+			m_relocationMap.insert(newPagePA) = relocation;
+			m_relocatedPages.insert(pageAddress + i * kPageSize) = relocation.allocatedPage;
+			logJournal(JournalRecordType::Page, newPagePA, &relocation, pageAddress + i * kPageSize);
+		}
+		
+		// write TT entries back
+		if (this->writeBlock(entriesAddress, entries, count * kPlatformAddressSize) == false)
+		{
+			for (uint32_t i = 0; i < count; i++)
+				this->writeAddress(entriesAddress + i * kPlatformAddressSize, entries[i]);
+		}
 	}
 	
 private:
@@ -262,29 +1009,209 @@ private:
 	{
 		ttentry_t	originalEntry;
 		virt_addr_t	allocatedPage;
+		virt_addr_t	entryAddress;	// VA of redirected entry
 		uint32_t	refCount;
 	};
 	
 	struct StagingInfo
 	{
-		virt_addr_t		targetPageVA;
 		phys_addr_t		allocatedPagePA;
 		ttentry_t		allocatedPageEntry;
 		WalkPosition	entryPosition;
 		Relocation		relocation;
+		
+		// lazy copy
+		phys_addr_t		originalPagePA;
+		uint32_t		uncopiedRangeCount;
+		PageRange		uncopiedRanges[kMaxUncopiedRanges];
 	};
 	
-	bool			m_relocationPending = false;
-	StagingInfo		m_stagingInfo;
+	AddressMap<StagingInfo>		m_pendingRelocations;	// target page VA -> staged leaf entry
+	virt_addr_t					m_lastPendingPage = kInvalidAddress;
+	std::vector<virt_addr_t>	m_pendingPages;			// scratch list for cancelRelocations
 	
-	std::vector<virt_addr_t>			m_relocatedPages;
-	std::map<virt_addr_t, Relocation>	m_relocationMap;
+	AddressMap<virt_addr_t>	m_relocatedPages;	// target page VA -> allocated page VA
+	AddressMap<Relocation>	m_relocationMap;	// PA of relocated table or page -> relocation
+	
+	std::vector<ttentry_t>	m_leafEntries;		// leaf table entries for relocateRange and entries of split block
+	
+	std::vector<UndoRecord>*	m_undoLog = nullptr;	// set by transaction while it prepares pages
+	
+	bool	m_lazyPageCopy = false;
+	
+	RelocationJournal*	m_journal = nullptr;
+	
+	PhysicalPagePool<PRIMITIVES>	m_pagePool;
 };
 
 template <typename PRIMITIVES>
 const typename PageRelocator<PRIMITIVES>::RelocatorCallback PageRelocator<PRIMITIVES>::DefaultCallback =
-[] (TTLevel level, TTGenericEntry* entry) -> ttentry_t
+[] (TTLevel level, TTGenericEntry* oldEntry, TTGenericEntry* newEntry) -> ttentry_t
+{
+	assert(newEntry != nullptr);
+	return newEntry->getDescriptor();
+};
+
+template <typename PRIMITIVES>
+const typename PageRelocator<PRIMITIVES>::RelocatorViewCallback PageRelocator<PRIMITIVES>::DefaultViewCallback =
+[] (TTLevel, const TTDescriptorView*, TTDescriptorView* newEntry) -> ttentry_t
+{
+	assert(newEntry != nullptr);
+	return newEntry->getDescriptor();
+};
+
+// Set of page relocations applied together
+// Pages are prepared one by one (tables on their path are cloned, which doesn't change translation), then commit
+// writes all staged leaf entries sorted by address, merging adjacent ones into single block writes, so each page
+// switches with one descriptor write only after every page of the set is prepared.
+// Any failure to prepare a page rolls back the whole set from undo log in one pass, as does rollback() or
+// destruction of uncommitted transaction. Only one transaction can be active for relocator at a time.
+template <typename PRIMITIVES>
+class RelocationTransaction
 {
-	assert(entry != nullptr);
-	return entry->getDescriptor();
+public:
+	
+	using Relocator = PageRelocator<PRIMITIVES>;
+	
+public:
+	
+	RelocationTransaction() = delete;
+	RelocationTransaction(const RelocationTransaction&) = delete;
+	RelocationTransaction& operator=(const RelocationTransaction&) = delete;
+	
+	RelocationTransaction(Relocator& relocator)
+		: m_relocator(relocator)
+	{}
+	
+	~RelocationTransaction()
+	{
+		if (m_committed == false)
+			rollback();
+	}
+	
+	virt_addr_t prepare(virt_addr_t address, typename Relocator::RelocatorCallback callback)
+	{
+		return prepare(address, Relocator::wrapCallback(callback));
+	}
+	
+	// Prepares page relocation and returns VA of page copy, kInvalidAddress if transaction was rolled back
+	virt_addr_t prepare(virt_addr_t address, typename Relocator::RelocatorViewCallback callback = Relocator::DefaultViewCallback)
+	{
+		if (m_failed || m_committed)
+			return kInvalidAddress;
+		
+		// pages relocated or pending outside of transaction can't be part of it
+		virt_addr_t newPageVA = kInvalidAddress;
+		if (m_relocator.isRelocationPendingFor(address) == false)
+		{
+			assert(m_relocator.m_undoLog == nullptr);
+			m_relocator.m_undoLog = &m_undoLog;
+			newPageVA = m_relocator.preparePageRelocationFor(address, callback);
+			m_relocator.m_undoLog = nullptr;
+		}
+		
+		// relocator returns false (zero) for relocated pages
+		if (newPageVA == kInvalidAddress || newPageVA == 0)
+		{
+			rollback();
+			return kInvalidAddress;
+		}
+		
+		m_pages.push_back(address & ~m_relocator.kPageMask);
+		
+		return newPageVA;
+	}
+	
+	// Applies all prepared relocations, returns false if transaction was rolled back or is empty
+	bool commit()
+	{
+		if (m_failed || m_committed || m_pages.empty())
+			return false;
+		
+		typedef typename Relocator::StagingInfo StagingInfo;
+		
+		m_entries.clear();
+		for (auto targetPageAddress : m_pages)
+		{
+			StagingInfo* stagingInfo = m_relocator.m_pendingRelocations.find(targetPageAddress);
+			assert(stagingInfo != nullptr);
+			
+			// finish lazy copy before page is mapped
+			m_relocator.copyOriginalRanges(*stagingInfo);
+			
+			virt_addr_t entryAddress = stagingInfo->entryPosition.tableAddress + stagingInfo->entryPosition.entryOffset;
+			m_entries.push_back({ entryAddress, stagingInfo->allocatedPageEntry });
+		}
+		
+		// write runs of adjacent leaf entries at once
+		std::sort(m_entries.begin(), m_entries.end(), [] (const LeafEntry& a, const LeafEntry& b) { return a.address < b.address; });
+		
+		for (size_t first = 0, last = 0; first < m_entries.size(); first = last)
+		{
+			m_descriptors.clear();
+			for (last = first; last < m_entries.size() && m_entries[last].address == m_entries[first].address + (last - first) * kPlatformAddressSize; last++)
+				m_descriptors.push_back(m_entries[last].descriptor);
+			
+			if (m_descriptors.size() == 1 || m_relocator.writeBlock(m_entries[first].address, m_descriptors.data(), m_descriptors.size() * kPlatformAddressSize) == false)
+			{
+				for (size_t i = first; i < last; i++)
+					m_relocator.writeAddress(m_entries[i].address, m_entries[i].descriptor);
+			}
+		}
+		
+		for (auto targetPageAddress : m_pages)
+		{
+			m_relocator.registerRelocatedPage(targetPageAddress, *m_relocator.m_pendingRelocations.find(targetPageAddress));
+			m_relocator.m_pendingRelocations.erase(targetPageAddress);
+		}
+		
+		m_undoLog.clear();
+		m_committed = true;
+		
+		return true;
+	}
+	
+	// Reverts all relocations prepared by transaction
+	void rollback()
+	{
+		if (m_committed)
+			return;
+		
+		m_relocator.rollbackUndoLog(m_undoLog);
+		m_pages.clear();
+		m_failed = true;
+	}
+	
+	size_t getPageCount() const
+	{
+		return m_pages.size();
+	}
+	
+	bool isCommitted() const
+	{
+		return m_committed;
+	}
+	
+	bool isRolledBack() const
+	{
+		return m_failed;
+	}
+	
+private:
+	
+	struct LeafEntry
+	{
+		virt_addr_t	address;
+		ttentry_t	descriptor;
+	};
+	
+	Relocator&	m_relocator;
+	bool		m_committed = false;
+	bool		m_failed = false;
+	
+	std::vector<virt_addr_t>	m_pages;
+	std::vector<typename Relocator::UndoRecord>	m_undoLog;
+	
+	std::vector<LeafEntry>		m_entries;
+	std::vector<ttentry_t>		m_descriptors;
 };
@@ -0,0 +1,194 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include "TTWalker.hpp"
+
+// Walker for translation regime known at compile time (e.g. 16K granule starting at L1 for iOS TTBR1)
+// T_SZ is region size offset (TCR_ELx.TxSZ). Forward walks are unrolled for every level and use
+// constant shifts and masks for table indices. Reverse walk, batches, enumeration and cache
+// management are inherited from TTWalker (caches are shared with unrolled walks).
+template <TTGranule GRANULE, TTLevel INITIAL_LEVEL, uint32_t T_SZ, typename PRIMITIVES>
+class StaticTTWalker : public TTWalker<PRIMITIVES>
+{
+	static_assert(GRANULE == TTGranule::Granule4K || GRANULE == TTGranule::Granule16K || GRANULE == TTGranule::Granule64K, "unsupported granule");
+	static_assert(uint32_t(INITIAL_LEVEL) < uint32_t(TTLevel::Count), "unsupported initial level");
+	static_assert(GRANULE != TTGranule::Granule64K || INITIAL_LEVEL != TTLevel::Level0, "64K granule has no level 0");
+	static_assert(T_SZ >= kPlatformAddressBits - 48 && T_SZ < kPlatformAddressBits, "region should be at most 48 bits");
+	static_assert(kPlatformAddressBits - T_SZ > GetLevelShift(GRANULE, INITIAL_LEVEL), "region is too small for initial level");
+	static_assert(kPlatformAddressBits - T_SZ <= GetLevelShift(GRANULE, INITIAL_LEVEL) + GetLevelIndexBits(GRANULE), "region is too large for initial level");
+
+	using Base = TTWalker<PRIMITIVES>;
+	using GenericEntryType = typename Base::GenericEntryType;
+	using ViewEntryType = typename Base::ViewEntryType;
+
+public:
+
+	static MMUConfig getMMUConfig()
+	{
+		MMUConfig mmuConfig;
+		mmuConfig.granule = GRANULE;
+		mmuConfig.initialLevel = INITIAL_LEVEL;
+		mmuConfig.regionSizeOffset = T_SZ;
+		return mmuConfig;
+	}
+
+public:
+
+	StaticTTWalker() = delete;
+
+	StaticTTWalker(virt_addr_t tableBase)
+		: Base(getMMUConfig(), tableBase)
+	{}
+
+	// Walker using copy of existing primitives (e.g. with mapped dumps or context)
+	StaticTTWalker(virt_addr_t tableBase, const PRIMITIVES& primitives)
+		: Base(getMMUConfig(), tableBase, primitives)
+	{}
+
+	WalkResult	walkTo(virt_addr_t address, TTGenericWalker::WalkerCallback callback = TTGenericWalker::DefaultCallback) override
+	{
+		return performWalkTo<GenericEntryType>(address, callback, this->m_walkCache);
+	}
+
+	template <typename CALLBACK>
+	WalkResult	walkTo(virt_addr_t address, CALLBACK callback)
+	{
+		return performWalkTo<GenericEntryType>(address, callback, this->m_walkCache);
+	}
+
+	template <typename CALLBACK>
+	WalkResult	walkViewTo(virt_addr_t address, CALLBACK callback)
+	{
+		return performWalkTo<ViewEntryType>(address, callback, this->m_walkCache);
+	}
+
+	phys_addr_t findPhysicalAddress(virt_addr_t address) override
+	{
+		TTTranslationCache::Translation translation;
+		if (this->m_translationCache.lookup(address, &translation))
+			return translation.outputAddress | (address & kPageMask);
+
+		auto callback = [] (WalkPosition*, TTDescriptorView*) -> WalkOperation { return WalkOperation::Continue; };
+		auto result = performWalkTo<ViewEntryType>(address, callback, this->m_walkCache);
+		if (result.getType() == WalkResultType::Complete)
+		{
+			// block descriptors map more than one page
+			virt_addr_t levelMask = (virt_addr_t(1) << GetLevelShift(GRANULE, result.getLevel())) - 1;
+			phys_addr_t outputAddress = result.getOutputAddress() | (address & levelMask);
+
+			this->m_translationCache.insert(address, outputAddress, result.getDescriptor(), result.getLevel());
+
+			return outputAddress;
+		}
+		else
+			return kInvalidAddress;
+	}
+
+private:
+
+	static const virt_addr_t kRegionMask = (virt_addr_t(1) << (kPlatformAddressBits - T_SZ)) - 1;
+	static const virt_addr_t kIndexMask = (virt_addr_t(1) << GetLevelIndexBits(GRANULE)) - 1;
+	static const virt_addr_t kPageMask = virt_addr_t(GRANULE) - 1;
+
+	// Selects walkLevel overload for the level at compile time
+	template <TTLevel LEVEL>
+	struct LevelTag {};
+
+	template <TTLevel LEVEL>
+	static offset_t getOffsetForLevel(virt_addr_t address)
+	{
+		return offset_t(((address & kRegionMask) >> GetLevelShift(GRANULE, LEVEL)) & kIndexMask) * kPlatformAddressSize;
+	}
+
+	template <typename ENTRY_TYPE, typename CALLBACK>
+	WalkResult	performWalkTo(virt_addr_t address, CALLBACK& callback, TTWalkCache& walkCache)
+	{
+		WalkPosition pos = {
+			.level = INITIAL_LEVEL,
+			.tableAddress = this->m_tableBase,
+			.entryOffset = 0
+		};
+
+		return walkLevel<ENTRY_TYPE>(pos, address, callback, walkCache, LevelTag<INITIAL_LEVEL>());
+	}
+
+	// Table levels, same checks as TTWalker::performWalkTo
+	// (levels are forced inline, otherwise compiler runs out of inlining budget for entry accessors)
+	template <typename ENTRY_TYPE, TTLevel LEVEL, typename CALLBACK>
+	__attribute__((always_inline))
+	WalkResult	walkLevel(WalkPosition& pos, virt_addr_t address, CALLBACK& callback, TTWalkCache& walkCache, LevelTag<LEVEL>)
+	{
+		WalkResult result;
+		result.level = LEVEL;
+
+		pos.level = LEVEL;
+		pos.entryOffset = getOffsetForLevel<LEVEL>(address);
+
+		auto entry = ENTRY_TYPE::template make<GRANULE, LEVEL>(this->readTableEntry(pos, address, walkCache));
+		result.descriptor = entry.getDescriptor();
+
+		// check is entry is valid
+		if (entry.isValid() == false)
+			return result.setType(WalkResultType::Failed).setOutputAddress(kInvalidAddress);
+
+		// level 0 entry is invalid if not table descriptor
+		if (LEVEL == TTLevel::Level0 && entry.isTableDescriptor() == false)
+			return result.setType(WalkResultType::Failed).setOutputAddress(kInvalidAddress);
+
+		// execute callback and interrupt walk if needed
+		if (callback(&pos, &entry) == WalkOperation::Stop)
+			return result.setType(WalkResultType::Stopped).setOutputAddress(entry.getOutputAddress());
+
+		// return block address if not table descriptor
+		if (entry.isTableDescriptor() == false)
+			return result.setType(WalkResultType::Complete).setOutputAddress(entry.getOutputAddress());
+
+		// save table descriptor for walks sharing the same path
+		walkCache.insert(LEVEL, address, entry.getDescriptor());
+
+		// get next table address
+		pos.tableAddress = this->physicalToVirtual(entry.getOutputAddress());
+		if (pos.tableAddress == kInvalidAddress)
+			return result.setType(WalkResultType::Failed).setOutputAddress(kInvalidAddress);
+
+		return walkLevel<ENTRY_TYPE>(pos, address, callback, walkCache, LevelTag<static_cast<TTLevel>(static_cast<uint32_t>(LEVEL) + 1)>());
+	}
+
+	// Last level, page descriptors only
+	template <typename ENTRY_TYPE, typename CALLBACK>
+	__attribute__((always_inline))
+	WalkResult	walkLevel(WalkPosition& pos, virt_addr_t address, CALLBACK& callback, TTWalkCache&, LevelTag<TTLevel::Level3>)
+	{
+		WalkResult result;
+		result.level = TTLevel::Level3;
+
+		pos.level = TTLevel::Level3;
+		pos.entryOffset = getOffsetForLevel<TTLevel::Level3>(address);
+
+		auto entry = ENTRY_TYPE::template make<GRANULE, TTLevel::Level3>(this->readAddress(pos.tableAddress + pos.entryOffset));
+		result.descriptor = entry.getDescriptor();
+
+		// check is entry is valid
+		if (entry.isValid() == false)
+			return result.setType(WalkResultType::Failed).setOutputAddress(kInvalidAddress);
+
+		// invalid if not page descriptor
+		if (entry.isPageDescriptor() == false)
+			return result.setType(WalkResultType::Failed).setOutputAddress(kInvalidAddress);
+
+		// execute callback and interrupt walk if needed
+		if (callback(&pos, &entry) == WalkOperation::Stop)
+			return result.setType(WalkResultType::Stopped).setOutputAddress(entry.getOutputAddress());
+
+		// return page address
+		return result.setType(WalkResultType::Complete).setOutputAddress(entry.getOutputAddress());
+	}
+};
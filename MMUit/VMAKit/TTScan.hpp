@@ -0,0 +1,409 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include "VMATypes.hpp"
+#include "VirtualAddress.hpp"
+#include "TTEntry.hpp"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VMA_SCAN_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define VMA_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Vector implementations of the scan, Default selects the best one supported by CPU
+enum class TTScanKernel {
+	Default		= 0,
+	Scalar		= 1,
+	SSE2		= 2,
+	AVX2		= 3,
+	NEON		= 4
+};
+
+// Entries of the largest (64K granule) table
+static const uint32_t kTTScanMaxEntries = 8192;
+static const uint32_t kTTScanBitmapWords = kTTScanMaxEntries / 64;
+
+// MARK: - Table Scan
+
+// Per entry classification of table entries, bit (i % 64) of word (i / 64) describes entry i
+// Only first (count + 63) / 64 words of bitmaps are filled by the scan
+struct TTTableScan
+{
+	uint32_t	count;
+
+	uint64_t	valid[kTTScanBitmapWords];	// valid bit set, entry type is decoded the same way as walker does
+	uint64_t	table[kTTScanBitmapWords];
+	uint64_t	block[kTTScanBitmapWords];
+	uint64_t	page[kTTScanBitmapWords];
+
+	// Attributes of block and page descriptors (table descriptors have no such bits)
+	uint64_t	af[kTTScanBitmapWords];
+	uint64_t	pxn[kTTScanBitmapWords];
+	uint64_t	xn[kTTScanBitmapWords];		// UXN for EL1&0 regime
+
+	bool isSet(const uint64_t* bitmap, uint32_t index) const
+	{
+		assert(index < count);
+		return (bitmap[index / 64] >> (index % 64)) & 1;
+	}
+
+	uint32_t countOf(const uint64_t* bitmap) const
+	{
+		uint32_t result = 0;
+		for (uint32_t word = 0; word < (count + 63) / 64; word++)
+			result += __builtin_popcountll(bitmap[word]);
+
+		return result;
+	}
+
+	// Calls visitor(index) for every set bit in ascending order, stops if visitor returns false
+	template <typename VISITOR>
+	bool forEach(const uint64_t* bitmap, VISITOR visitor) const
+	{
+		for (uint32_t word = 0; word < (count + 63) / 64; word++)
+		{
+			for (uint64_t bits = bitmap[word]; bits != 0; bits &= bits - 1)
+			{
+				if (visitor(word * 64 + __builtin_ctzll(bits)) == false)
+					return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+// MARK: - Table Scanner
+
+// Classifies raw table entries in one pass without constructing entry objects
+// Descriptor bits are gathered 64 entries at a time into bitplanes, so type and attribute bitmaps
+// are produced with a few word operations per 64 entries, output addresses are decoded in vector registers
+class TTTableScanner
+{
+public:
+
+	// Scans count entries of table at level, output addresses (kInvalidAddress for invalid entries) are stored
+	// to outputAddresses if it is not nullptr, it may point to entries to decode them in place
+	static void scan(TTGranule granule, TTLevel level, const ttentry_t* entries, uint32_t count,
+					 TTTableScan* result, phys_addr_t* outputAddresses = nullptr, TTScanKernel kernel = TTScanKernel::Default)
+	{
+		assert(count <= kTTScanMaxEntries);
+
+		if (kernel == TTScanKernel::Default)
+			kernel = getDefaultKernel();
+
+		assert(isKernelSupported(kernel));
+
+		result->count = count;
+
+		if (outputAddresses != nullptr)
+			scan<true>(kernel, Parameters(granule, level), entries, count, result, outputAddresses);
+		else
+			scan<false>(kernel, Parameters(granule, level), entries, count, result, outputAddresses);
+	}
+
+	static bool isKernelSupported(TTScanKernel kernel)
+	{
+		switch (kernel)
+		{
+			case TTScanKernel::Default:
+			case TTScanKernel::Scalar:
+				return true;
+#if VMA_SCAN_X86
+			case TTScanKernel::SSE2:
+				return true;
+			case TTScanKernel::AVX2:
+				return __builtin_cpu_supports("avx2");
+#endif
+#if VMA_SCAN_NEON
+			case TTScanKernel::NEON:
+				return true;
+#endif
+			default:
+				return false;
+		}
+	}
+
+	static TTScanKernel getDefaultKernel()
+	{
+		static const TTScanKernel kernel =
+			isKernelSupported(TTScanKernel::AVX2)? TTScanKernel::AVX2 :
+			isKernelSupported(TTScanKernel::SSE2)? TTScanKernel::SSE2 :
+			isKernelSupported(TTScanKernel::NEON)? TTScanKernel::NEON : TTScanKernel::Scalar;
+
+		return kernel;
+	}
+
+private:
+
+	static const uint32_t kAFBit = 10;
+	static const uint32_t kPXNBit = 53;
+	static const uint32_t kXNBit = 54;
+
+	// Level specific decoding, same semantics as TTDescriptorView (see kTTDescriptorLayouts)
+	struct Parameters
+	{
+		Parameters(TTGranule granule, TTLevel level)
+		{
+			const TTDescriptorLayout& layout = kTTDescriptorLayouts[(GetGranuleShift(granule) - 12) / 2][uint32_t(level)];
+
+			// every valid entry is table at level 0 and page at level 3, other levels have blocks if type bit is clear
+			isTableLevel = (layout.tableMask == kTTDescriptorValidBit);
+			isLeafLevel = (level == TTLevel::Level3);
+			tableOutputMask = kTTDescriptorOutputAddressMask & ~((ttentry_t(1) << layout.tableShift) - 1);
+			blockOutputMask = kTTDescriptorOutputAddressMask & ~((ttentry_t(1) << layout.blockShift) - 1);
+		}
+
+		bool		isTableLevel;
+		bool		isLeafLevel;
+		ttentry_t	tableOutputMask;	// table and page descriptors
+		ttentry_t	blockOutputMask;	// same as table mask at levels without blocks
+	};
+
+	// Raw descriptor bits of 64 entries
+	struct Bitplanes
+	{
+		uint64_t	valid;
+		uint64_t	type;
+		uint64_t	af;
+		uint64_t	pxn;
+		uint64_t	xn;
+	};
+
+	template <bool OUTPUT>
+	static void scan(TTScanKernel kernel, const Parameters& params, const ttentry_t* entries, uint32_t count,
+					 TTTableScan* result, phys_addr_t* outputAddresses)
+	{
+		for (uint32_t base = 0; base < count; base += 64)
+		{
+			uint32_t groupCount = std::min<uint32_t>(64, count - base);
+			phys_addr_t* groupOutput = (OUTPUT)? outputAddresses + base : nullptr;
+			Bitplanes planes = { 0, 0, 0, 0, 0 };
+			uint32_t done = 0;
+
+			switch (kernel)
+			{
+#if VMA_SCAN_X86
+				case TTScanKernel::SSE2: done = scanSSE2<OUTPUT>(params, entries + base, groupCount, &planes, groupOutput); break;
+				case TTScanKernel::AVX2: done = scanAVX2<OUTPUT>(params, entries + base, groupCount, &planes, groupOutput); break;
+#endif
+#if VMA_SCAN_NEON
+				case TTScanKernel::NEON: done = scanNEON<OUTPUT>(params, entries + base, groupCount, &planes, groupOutput); break;
+#endif
+				default: break;
+			}
+
+			// scalar kernel and vector tails
+			scanScalar<OUTPUT>(params, entries + base, done, groupCount, &planes, groupOutput);
+
+			storeGroup(params, base / 64, groupCount, planes, result);
+		}
+	}
+
+	static void storeGroup(const Parameters& params, uint32_t word, uint32_t groupCount, const Bitplanes& planes, TTTableScan* result)
+	{
+		uint64_t present = (groupCount == 64)? ~uint64_t(0) : (uint64_t(1) << groupCount) - 1;
+		uint64_t valid = planes.valid & present;
+		uint64_t table = (params.isLeafLevel)? 0 : (params.isTableLevel)? valid : valid & planes.type;
+		uint64_t mapping = valid & ~table;
+
+		result->valid[word] = valid;
+		result->table[word] = table;
+		result->block[word] = (params.isLeafLevel)? 0 : mapping;
+		result->page[word] = (params.isLeafLevel)? valid : 0;
+
+		result->af[word] = planes.af & mapping;
+		result->pxn[word] = planes.pxn & mapping;
+		result->xn[word] = planes.xn & mapping;
+	}
+
+	template <bool OUTPUT>
+	static void scanScalar(const Parameters& params, const ttentry_t* entries, uint32_t first, uint32_t groupCount,
+						   Bitplanes* planes, phys_addr_t* outputAddresses)
+	{
+		// kept in registers, output stores could alias planes and parameters otherwise
+		Bitplanes bits = *planes;
+		const ttentry_t tableMask = params.tableOutputMask;
+		const ttentry_t blockMask = params.blockOutputMask;
+
+		for (uint32_t i = first; i < groupCount; i++)
+		{
+			ttentry_t descriptor = entries[i];
+			uint64_t typeBit = (descriptor >> 1) & 1;
+
+			bits.valid |= (descriptor & 1) << i;
+			bits.type |= typeBit << i;
+			bits.af |= ((descriptor >> kAFBit) & 1) << i;
+			bits.pxn |= ((descriptor >> kPXNBit) & 1) << i;
+			bits.xn |= ((descriptor >> kXNBit) & 1) << i;
+
+			if (OUTPUT)
+			{
+				ttentry_t mask = (typeBit)? tableMask : blockMask;
+				outputAddresses[i] = (descriptor & 1)? descriptor & mask : kInvalidAddress;
+			}
+		}
+
+		*planes = bits;
+	}
+
+#if VMA_SCAN_X86
+
+	// Sign bit of every 64-bit lane broadcasted to the whole lane
+	static __m128i laneMaskSSE2(__m128i shifted)
+	{
+		return _mm_shuffle_epi32(_mm_srai_epi32(shifted, 31), _MM_SHUFFLE(3, 3, 1, 1));
+	}
+
+	template <uint32_t BIT>
+	static uint64_t bitsSSE2(__m128i descriptors)
+	{
+		return uint64_t(_mm_movemask_pd(_mm_castsi128_pd(_mm_slli_epi64(descriptors, 63 - BIT))));
+	}
+
+	template <bool OUTPUT>
+	static uint32_t scanSSE2(const Parameters& params, const ttentry_t* entries, uint32_t groupCount,
+							 Bitplanes* planes, phys_addr_t* outputAddresses)
+	{
+		const __m128i tableMask = _mm_set1_epi64x(params.tableOutputMask);
+		const __m128i blockMask = _mm_set1_epi64x(params.blockOutputMask);
+		const __m128i invalid = _mm_set1_epi64x(kInvalidAddress);
+
+		Bitplanes bits = *planes;
+		uint32_t i = 0;
+		for (; i + 2 <= groupCount; i += 2)
+		{
+			__m128i descriptors = _mm_loadu_si128((const __m128i*)(entries + i));
+			__m128i validBit = _mm_slli_epi64(descriptors, 63);
+			__m128i typeBit = _mm_slli_epi64(descriptors, 62);
+
+			bits.valid |= uint64_t(_mm_movemask_pd(_mm_castsi128_pd(validBit))) << i;
+			bits.type |= uint64_t(_mm_movemask_pd(_mm_castsi128_pd(typeBit))) << i;
+			bits.af |= bitsSSE2<kAFBit>(descriptors) << i;
+			bits.pxn |= bitsSSE2<kPXNBit>(descriptors) << i;
+			bits.xn |= bitsSSE2<kXNBit>(descriptors) << i;
+
+			if (OUTPUT)
+			{
+				__m128i isType = laneMaskSSE2(typeBit);
+				__m128i isValid = laneMaskSSE2(validBit);
+				__m128i mask = _mm_or_si128(_mm_and_si128(isType, tableMask), _mm_andnot_si128(isType, blockMask));
+				__m128i address = _mm_or_si128(_mm_and_si128(_mm_and_si128(descriptors, mask), isValid), _mm_andnot_si128(isValid, invalid));
+				_mm_storeu_si128((__m128i*)(outputAddresses + i), address);
+			}
+		}
+
+		*planes = bits;
+		return i;
+	}
+
+	__attribute__((target("avx2")))
+	static __m256i laneMaskAVX2(__m256i shifted)
+	{
+		return _mm256_shuffle_epi32(_mm256_srai_epi32(shifted, 31), _MM_SHUFFLE(3, 3, 1, 1));
+	}
+
+	template <uint32_t BIT>
+	__attribute__((target("avx2")))
+	static uint64_t bitsAVX2(__m256i descriptors)
+	{
+		return uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(descriptors, 63 - BIT))));
+	}
+
+	template <bool OUTPUT>
+	__attribute__((target("avx2")))
+	static uint32_t scanAVX2(const Parameters& params, const ttentry_t* entries, uint32_t groupCount,
+							 Bitplanes* planes, phys_addr_t* outputAddresses)
+	{
+		const __m256i tableMask = _mm256_set1_epi64x(params.tableOutputMask);
+		const __m256i blockMask = _mm256_set1_epi64x(params.blockOutputMask);
+		const __m256i invalid = _mm256_set1_epi64x(kInvalidAddress);
+
+		Bitplanes bits = *planes;
+		uint32_t i = 0;
+		for (; i + 4 <= groupCount; i += 4)
+		{
+			__m256i descriptors = _mm256_loadu_si256((const __m256i*)(entries + i));
+			__m256i validBit = _mm256_slli_epi64(descriptors, 63);
+			__m256i typeBit = _mm256_slli_epi64(descriptors, 62);
+
+			bits.valid |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(validBit))) << i;
+			bits.type |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(typeBit))) << i;
+			bits.af |= bitsAVX2<kAFBit>(descriptors) << i;
+			bits.pxn |= bitsAVX2<kPXNBit>(descriptors) << i;
+			bits.xn |= bitsAVX2<kXNBit>(descriptors) << i;
+
+			if (OUTPUT)
+			{
+				__m256i isType = laneMaskAVX2(typeBit);
+				__m256i isValid = laneMaskAVX2(validBit);
+				__m256i mask = _mm256_or_si256(_mm256_and_si256(isType, tableMask), _mm256_andnot_si256(isType, blockMask));
+				__m256i address = _mm256_or_si256(_mm256_and_si256(_mm256_and_si256(descriptors, mask), isValid), _mm256_andnot_si256(isValid, invalid));
+				_mm256_storeu_si256((__m256i*)(outputAddresses + i), address);
+			}
+		}
+
+		*planes = bits;
+		return i;
+	}
+
+#endif // VMA_SCAN_X86
+
+#if VMA_SCAN_NEON
+
+	// Bit of both lanes packed into two lowest bits
+	template <uint32_t BIT>
+	static uint64_t bitsNEON(uint64x2_t descriptors)
+	{
+		const int64_t shifts[2] = { -int64_t(BIT), 1 - int64_t(BIT) };
+		const uint64_t masks[2] = { 1, 2 };
+		return vaddvq_u64(vandq_u64(vshlq_u64(descriptors, vld1q_s64(shifts)), vld1q_u64(masks)));
+	}
+
+	template <bool OUTPUT>
+	static uint32_t scanNEON(const Parameters& params, const ttentry_t* entries, uint32_t groupCount,
+							 Bitplanes* planes, phys_addr_t* outputAddresses)
+	{
+		const uint64x2_t tableMask = vdupq_n_u64(params.tableOutputMask);
+		const uint64x2_t blockMask = vdupq_n_u64(params.blockOutputMask);
+		const uint64x2_t invalid = vdupq_n_u64(kInvalidAddress);
+
+		Bitplanes bits = *planes;
+		uint32_t i = 0;
+		for (; i + 2 <= groupCount; i += 2)
+		{
+			uint64x2_t descriptors = vld1q_u64(entries + i);
+
+			bits.valid |= bitsNEON<0>(descriptors) << i;
+			bits.type |= bitsNEON<1>(descriptors) << i;
+			bits.af |= bitsNEON<kAFBit>(descriptors) << i;
+			bits.pxn |= bitsNEON<kPXNBit>(descriptors) << i;
+			bits.xn |= bitsNEON<kXNBit>(descriptors) << i;
+
+			if (OUTPUT)
+			{
+				uint64x2_t isType = vtstq_u64(descriptors, vdupq_n_u64(kTTDescriptorTableBit));
+				uint64x2_t isValid = vtstq_u64(descriptors, vdupq_n_u64(kTTDescriptorValidBit));
+				uint64x2_t mask = vbslq_u64(isType, tableMask, blockMask);
+				vst1q_u64(outputAddresses + i, vbslq_u64(isValid, vandq_u64(descriptors, mask), invalid));
+			}
+		}
+
+		*planes = bits;
+		return i;
+	}
+
+#endif // VMA_SCAN_NEON
+};
@@ -13,6 +13,8 @@
 #include "TTEntry.h"
 #include "MMUConfig.h"
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +29,13 @@ typedef struct {
 	uintptr_t			(*read_address)(virt_addr_t address);
 	virt_addr_t 		(*physical_to_virtual)(phys_addr_t address);
 	
+	// fields below were added later and are kept at the end to preserve layout of the fields above
+	
+	bool				(*read_block)(virt_addr_t address, void* dst, size_t size);	// optional
+	
+	// cpp object (see ttwalker_Create)
+	void*				object;
+	
 } ttwalker;
 
 #ifndef __cplusplus
@@ -56,6 +65,12 @@ typedef struct {
 	phys_addr_t		outputAddress;
 } WalkResult;
 	
+typedef struct {
+	uint64_t	hits;
+	uint64_t	misses;
+	uint64_t	evictions;
+} TTCacheStats;
+	
 #endif
 
 typedef WalkOperation (*ttwalker_callback)(WalkPosition* position, TTEntryDetails* entry, uintptr_t user_data);
@@ -63,6 +78,23 @@ typedef WalkOperation (*ttwalker_callback)(WalkPosition* position, TTEntryDetail
 WalkResult	ttwalker_Walk(ttwalker* walker, virt_addr_t address, ttwalker_callback callback);
 bool		ttwalker_ReverseWalk(ttwalker* walker, virt_addr_t address, ttwalker_callback callback);
 phys_addr_t ttwalker_FindPhysicalAddress(ttwalker* walker, virt_addr_t address);
+void		ttwalker_TranslateBatch(ttwalker* walker, const virt_addr_t* in, phys_addr_t* out, size_t count);
+
+typedef struct {
+	TTCacheStats	translation_cache;
+	TTCacheStats	walk_cache;
+} ttwalker_stats;
+
+// Functions above construct temporary walker for every call unless handle is created with ttwalker_Create.
+// Created handle owns walker with caches which persist between calls, callbacks and config are bound on creation.
+// Caches are updated by every call, so created handle shouldn't be used from multiple threads at once.
+// tlb_sets or tlb_ways of zero disables translation cache, walk_cache_entries of zero disables walk cache
+void		ttwalker_Create(ttwalker* walker, uint32_t tlb_sets, uint32_t tlb_ways, uint32_t walk_cache_entries);
+// caches are not coherent with translation tables, invalidate them after tables are modified
+void		ttwalker_Invalidate(ttwalker* walker, virt_addr_t address);
+void		ttwalker_InvalidateAll(ttwalker* walker);
+ttwalker_stats ttwalker_GetStats(ttwalker* walker);
+void		ttwalker_Destroy(ttwalker* walker);
 
 #ifdef __cplusplus
 }
@@ -10,7 +10,12 @@
 
 #include "VMAPlatform.hpp"
 #include "MMUConfig.hpp"
+#include "TTCache.hpp"
+#include "TTScan.hpp"
+#include "TaskPool.hpp"
+#include <algorithm>
 #include <functional>
+#include <vector>
 
 enum class WalkOperation {
 	Stop		= false,
@@ -47,16 +52,37 @@ struct WalkResult {
 	WalkResult&		setOutputAddress(phys_addr_t address) {this->outputAddress = address; return *this; }
 };
 
+struct TranslationMapping {
+	virt_addr_t	virtualAddress;	// VA of the whole block or page
+	uint64_t	size;
+	phys_addr_t	outputAddress;
+	ttentry_t	descriptor;
+	TTLevel		level;
+};
+
+struct TranslationExtent {
+	virt_addr_t	virtualAddress;
+	uint64_t	size;
+	phys_addr_t	outputAddress;	// kInvalidAddress for unmapped range
+	ttentry_t	attributes;		// block or page descriptor attributes
+	
+	bool		isValid() const { return outputAddress != kInvalidAddress; }
+};
+
 class TTGenericWalker
 {
 public:
 	
 	// WalkerCallback callback is called for every level walker is going through
 	using WalkerCallback = std::function<WalkOperation(WalkPosition* position, TTGenericEntry* entry)>;
+	// EnumerateCallback callback is called for every valid block or page descriptor
+	using EnumerateCallback = std::function<WalkOperation(const TranslationMapping& mapping)>;
 	static const WalkerCallback DefaultCallback;
 	
 public:
 	
+	virtual ~TTGenericWalker() {};
+	
 	virtual WalkResult	walkTo(virt_addr_t address, WalkerCallback callback) = 0;
 	virtual bool		reverseWalkFrom(virt_addr_t address, WalkerCallback callback = DefaultCallback) = 0;
 	virtual phys_addr_t findPhysicalAddress(virt_addr_t address) = 0;
@@ -69,9 +95,16 @@ const TTGenericWalker::WalkerCallback TTGenericWalker::DefaultCallback =
 		return WalkOperation::Continue;
 	};
 
+template <TTGranule GRANULE, TTLevel INITIAL_LEVEL, uint32_t T_SZ, typename PRIMITIVES>
+class StaticTTWalker;
+
 template <typename PRIMITIVES>
 class TTWalker : public PRIMITIVES, public TTGenericWalker
 {
+	// unrolled walker uses caches and entry types of this walker
+	template <TTGranule GRANULE, TTLevel INITIAL_LEVEL, uint32_t T_SZ, typename STATIC_PRIMITIVES>
+	friend class StaticTTWalker;
+	
 public:
 
 	TTWalker() = delete;
@@ -79,48 +112,310 @@ public:
 	TTWalker(MMUConfig mmuConfig, virt_addr_t tableBase)
 		: m_mmuConfig(mmuConfig), m_tableBase(tableBase)
 	{}
+	
+	// Walker using copy of existing primitives (e.g. with mapped dumps or context)
+	TTWalker(MMUConfig mmuConfig, virt_addr_t tableBase, const PRIMITIVES& primitives)
+		: PRIMITIVES(primitives), m_mmuConfig(mmuConfig), m_tableBase(tableBase)
+	{}
 
 	WalkResult	walkTo(virt_addr_t address, WalkerCallback callback = DefaultCallback) override
 	{
-		switch (m_mmuConfig.granule) {
-			case TTGranule::Granule4K: return performWalkTo<TTGranule::Granule4K>(address, callback);
-			case TTGranule::Granule16K: return performWalkTo<TTGranule::Granule16K>(address, callback);
-			case TTGranule::Granule64K: return performWalkTo<TTGranule::Granule64K>(address, callback);
-				
-			default: assert(0);
+		return walkTo(address, callback, m_walkCache);
+	}
+	
+	// Same as above, but callback type is known at compile time so it can be inlined into the walk
+	// (used for lambdas, WalkerCallback objects still go through the virtual interface)
+	template <typename CALLBACK>
+	WalkResult	walkTo(virt_addr_t address, CALLBACK callback)
+	{
+		return walkTo(address, callback, m_walkCache);
+	}
+	
+	// Walk with callback taking TTDescriptorView instead of TTGenericEntry, entry changes made by callback are followed
+	// Views are decoded without virtual calls, so this is the fastest walk for callbacks which inspect descriptors
+	template <typename CALLBACK>
+	WalkResult	walkViewTo(virt_addr_t address, CALLBACK callback)
+	{
+		return walkViewTo(address, callback, m_walkCache);
+	}
+	
+	bool reverseWalkFrom(virt_addr_t address, WalkerCallback callback) override
+	{
+		auto viewCallback = [&callback] (WalkPosition* position, TTDescriptorView* view) -> WalkOperation
+		{
+			TTEntrySnapshot entry(*view);
+			return callback(position, entry.get());
+		};
+		
+		return reverseWalkViewFrom(address, viewCallback);
+	}
+	
+	// Reverse walk with callback taking TTDescriptorView, changes made to views are not written anywhere
+	template <typename CALLBACK>
+	bool reverseWalkViewFrom(virt_addr_t address, CALLBACK callback)
+	{
+		return performReverseWalkFrom(address, callback);
+	}
+	
+	phys_addr_t findPhysicalAddress(virt_addr_t address) override
+	{
+		return findPhysicalAddress(address, m_walkCache);
+	}
+	
+	// Translate count addresses from in[] to out[] (kInvalidAddress for unmapped addresses)
+	// Addresses are translated in VA order so each table descriptor is read once per batch
+	void translateBatch(const virt_addr_t* in, phys_addr_t* out, size_t count)
+	{
+		if (in == nullptr || out == nullptr || count == 0)
+			return;
+		
+		virt_addr_t pageMask = uint32_t(m_mmuConfig.granule) - 1;
+		
+		// sort indices to keep addresses with shared table prefix together
+		std::vector<size_t> order(count);
+		for (size_t i = 0; i < count; i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [in] (size_t a, size_t b) { return in[a] < in[b]; });
+		
+		// with sorted input single entry per level is enough to read every descriptor once
+		TTWalkCache batchCache;
+		if (m_walkCache.isEnabled() == false)
+			batchCache.configure(m_mmuConfig.granule, m_mmuConfig.regionSizeOffset, 1);
+		TTWalkCache& walkCache = (m_walkCache.isEnabled())? m_walkCache : batchCache;
+		
+		virt_addr_t lastPage = kInvalidAddress;
+		phys_addr_t lastPagePA = kInvalidAddress;
+		
+		for (size_t i = 0; i < count; i++)
+		{
+			virt_addr_t address = in[order[i]];
+			virt_addr_t page = address & ~pageMask;
+			
+			if (page != lastPage)
+			{
+				lastPage = page;
+				lastPagePA = findPhysicalAddress(page, walkCache);
+			}
+			
+			out[order[i]] = (lastPagePA != kInvalidAddress)? lastPagePA | (address & pageMask) : kInvalidAddress;
 		}
+	}
+	
+	// Visits every valid block and page descriptor of the region in VA order
+	// regionBase selects upper (TTBR1) or lower (TTBR0) region, returns false if stopped by callback
+	bool enumerateMappings(EnumerateCallback callback, virt_addr_t regionBase = 0)
+	{
+		virt_addr_t regionMask = getRegionMask();
+		return enumerateRegion(regionBase & ~regionMask, 0, regionMask, callback);
+	}
+	
+	// Visits valid descriptors overlapping [begin, end), mappings crossing range boundaries are reported in full
+	bool enumerateMappings(virt_addr_t begin, virt_addr_t end, EnumerateCallback callback)
+	{
+		if (begin >= end)
+			return true;
 		
-		return WalkResult();
+		// range can't cross translation region
+		virt_addr_t regionMask = getRegionMask();
+		virt_addr_t regionBase = begin & ~regionMask;
+		virt_addr_t last = ((end - 1) & ~regionMask) == regionBase? (end - 1) & regionMask : regionMask;
+		
+		return enumerateRegion(regionBase, begin & regionMask, last, callback);
 	}
 	
-	bool reverseWalkFrom(virt_addr_t address, WalkerCallback callback) override
+	// Same as enumerateMappings, but L1 and L2 tables are distributed across threadCount threads
+	// (zero uses all hardware threads). Parallel walk requires thread-safe primitives (see Primitives::isThreadSafe),
+	// otherwise calling thread is used. Mappings are buffered and callback is called on calling thread in VA order
+	bool enumerateMappingsParallel(EnumerateCallback callback, virt_addr_t regionBase = 0, uint32_t threadCount = 0)
+	{
+		virt_addr_t regionMask = getRegionMask();
+		return enumerateRegionParallel(regionBase & ~regionMask, 0, regionMask, callback, threadCount);
+	}
+	
+	bool enumerateMappingsParallel(virt_addr_t begin, virt_addr_t end, EnumerateCallback callback, uint32_t threadCount = 0)
+	{
+		if (begin >= end)
+			return true;
+		
+		// range can't cross translation region
+		virt_addr_t regionMask = getRegionMask();
+		virt_addr_t regionBase = begin & ~regionMask;
+		virt_addr_t last = ((end - 1) & ~regionMask) == regionBase? (end - 1) & regionMask : regionMask;
+		
+		return enumerateRegionParallel(regionBase, begin & regionMask, last, callback, threadCount);
+	}
+	
+	// Returns physically contiguous extents with uniform attributes mapping [begin, end)
+	// Block descriptors and runs of consecutive pages are merged, unmapped ranges are reported as gaps
+	std::vector<TranslationExtent> translateRange(virt_addr_t begin, virt_addr_t end)
+	{
+		std::vector<TranslationExtent> extents;
+		
+		if (begin >= end)
+			return extents;
+		
+		// range can't cross translation region
+		virt_addr_t regionMask = getRegionMask();
+		virt_addr_t regionBase = begin & ~regionMask;
+		virt_addr_t first = begin & regionMask;
+		virt_addr_t last = ((end - 1) & ~regionMask) == regionBase? (end - 1) & regionMask : regionMask;
+		
+		virt_addr_t cursor = first;
+		bool isComplete = false;
+		
+		auto callback = [&] (const TranslationMapping& mapping) -> WalkOperation
+		{
+			virt_addr_t mappingOffset = mapping.virtualAddress & regionMask;
+			virt_addr_t mappingFirst = std::max(first, mappingOffset);
+			virt_addr_t mappingLast = std::min(last, mappingOffset + (mapping.size - 1));
+			
+			if (mappingFirst > cursor)
+				appendExtent(extents, regionBase | cursor, mappingFirst - cursor, kInvalidAddress, 0);
+			
+			appendExtent(extents, regionBase | mappingFirst, mappingLast - mappingFirst + 1,
+						 mapping.outputAddress + (mappingFirst - mappingOffset),
+						 mapping.descriptor & kTTDescriptorAttributesMask);
+			
+			cursor = mappingLast + 1;
+			isComplete = (mappingLast == last);
+			
+			return WalkOperation::Continue;
+		};
+		
+		enumerateRegion(regionBase, first, last, callback);
+		
+		if (isComplete == false)
+			appendExtent(extents, regionBase | cursor, last - cursor + 1, kInvalidAddress, 0);
+		
+		return extents;
+	}
+	
+	// Translation cache (TLB) used by findPhysicalAddress, disabled by default
+	
+	void enableTranslationCache(uint32_t sets = TTTranslationCache::kDefaultSets, uint32_t ways = TTTranslationCache::kDefaultWays)
+	{
+		m_translationCache.configure(m_mmuConfig.granule, sets, ways);
+	}
+	
+	void disableTranslationCache()
+	{
+		m_translationCache.configure(m_mmuConfig.granule, 0, 0);
+	}
+	
+	void invalidateTranslation(virt_addr_t address)
+	{
+		m_translationCache.invalidate(address);
+	}
+	
+	void invalidateTranslationRange(virt_addr_t begin, virt_addr_t end)
+	{
+		m_translationCache.invalidateRange(begin, end);
+	}
+	
+	void invalidateAllTranslations()
+	{
+		m_translationCache.invalidateAll();
+	}
+	
+	TTCacheStats getTranslationCacheStats()
+	{
+		return m_translationCache.getStats();
+	}
+	
+	// Walk cache for intermediate table descriptors used by every walk, disabled by default
+	
+	void enableWalkCache(uint32_t entriesPerLevel = TTWalkCache::kDefaultEntriesPerLevel)
+	{
+		m_walkCache.configure(m_mmuConfig.granule, m_mmuConfig.regionSizeOffset, entriesPerLevel);
+	}
+	
+	void disableWalkCache()
+	{
+		m_walkCache.configure(m_mmuConfig.granule, m_mmuConfig.regionSizeOffset, 0);
+	}
+	
+	void invalidateWalkCache(virt_addr_t address)
+	{
+		m_walkCache.invalidate(address);
+	}
+	
+	void invalidateAllWalkCache()
+	{
+		m_walkCache.invalidateAll();
+	}
+	
+	TTCacheStats getWalkCacheStats()
+	{
+		return m_walkCache.getStats();
+	}
+	
+private:
+	
+	// Entry types walk callbacks are called with, both are decoded at compile time for every level
+	struct GenericEntryType
+	{
+		template <TTGranule GRANULE, TTLevel LEVEL>
+		static TTEntry<GRANULE, LEVEL> make(ttentry_t descriptor) { return TTEntry<GRANULE, LEVEL>(descriptor); }
+	};
+	
+	struct ViewEntryType
+	{
+		template <TTGranule GRANULE, TTLevel LEVEL>
+		static TTDescriptorView make(ttentry_t descriptor) { return TTDescriptorView(GRANULE, LEVEL, descriptor); }
+	};
+	
+	template <typename CALLBACK>
+	WalkResult	walkTo(virt_addr_t address, CALLBACK& callback, TTWalkCache& walkCache)
+	{
+		return performWalkTo<GenericEntryType>(address, callback, walkCache);
+	}
+	
+	template <typename CALLBACK>
+	WalkResult	walkViewTo(virt_addr_t address, CALLBACK& callback, TTWalkCache& walkCache)
+	{
+		return performWalkTo<ViewEntryType>(address, callback, walkCache);
+	}
+	
+	template <typename ENTRY_TYPE, typename CALLBACK>
+	WalkResult	performWalkTo(virt_addr_t address, CALLBACK& callback, TTWalkCache& walkCache)
 	{
 		switch (m_mmuConfig.granule) {
-			case TTGranule::Granule4K: return performReverseWalkFrom<TTGranule::Granule4K>(address, callback);
-			case TTGranule::Granule16K: return performReverseWalkFrom<TTGranule::Granule16K>(address, callback);
-			case TTGranule::Granule64K: return performReverseWalkFrom<TTGranule::Granule64K>(address, callback);
+			case TTGranule::Granule4K: return performWalkTo<ENTRY_TYPE, TTGranule::Granule4K>(address, callback, walkCache);
+			case TTGranule::Granule16K: return performWalkTo<ENTRY_TYPE, TTGranule::Granule16K>(address, callback, walkCache);
+			case TTGranule::Granule64K: return performWalkTo<ENTRY_TYPE, TTGranule::Granule64K>(address, callback, walkCache);
 				
 			default: assert(0);
 		}
 		
-		return false;
+		return WalkResult();
 	}
 	
-	phys_addr_t findPhysicalAddress(virt_addr_t address) override
+	phys_addr_t findPhysicalAddress(virt_addr_t address, TTWalkCache& walkCache)
 	{
 		virt_addr_t pageMask = uint32_t(m_mmuConfig.granule) - 1;
 		
-		auto result = walkTo(address);
+		TTTranslationCache::Translation translation;
+		if (m_translationCache.lookup(address, &translation))
+			return translation.outputAddress | (address & pageMask);
+		
+		auto callback = [] (WalkPosition*, TTDescriptorView*) -> WalkOperation { return WalkOperation::Continue; };
+		auto result = walkViewTo(address, callback, walkCache);
 		if (result.getType() == WalkResultType::Complete)
-			return result.getOutputAddress() | (address & pageMask);
+		{
+			// block descriptors map more than one page
+			virt_addr_t levelMask = (virt_addr_t(1) << GetLevelShift(m_mmuConfig.granule, result.getLevel())) - 1;
+			phys_addr_t outputAddress = result.getOutputAddress() | (address & levelMask);
+			
+			m_translationCache.insert(address, outputAddress, result.getDescriptor(), result.getLevel());
+			
+			return outputAddress;
+		}
 		else
 			return kInvalidAddress;
 	}
 	
-private:
-	
-	template <TTGranule GRANULE>
-	WalkResult	performWalkTo(virt_addr_t address, WalkerCallback callback = DefaultCallback)
+	template <typename ENTRY_TYPE, TTGranule GRANULE, typename CALLBACK>
+	WalkResult	performWalkTo(virt_addr_t address, CALLBACK& callback, TTWalkCache& walkCache)
 	{
 		WalkResult result;
 		WalkPosition pos = {
@@ -143,7 +438,7 @@ private:
 			{
 				case TTLevel::Level0:
 				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level0>(this->readAddress(pos.tableAddress + pos.entryOffset));
+					auto entry = ENTRY_TYPE::template make<GRANULE, TTLevel::Level0>(readTableEntry(pos, address, walkCache));
 					result.descriptor = entry.getDescriptor();
 					
 					// check is entry is valid
@@ -158,6 +453,9 @@ private:
 					if (callback(&pos, &entry) == WalkOperation::Stop)
 						return result.setType(WalkResultType::Stopped).setOutputAddress(entry.getOutputAddress());
 					
+					// save table descriptor for walks sharing the same path
+					walkCache.insert(pos.level, address, entry.getDescriptor());
+					
 					// get next table address
 					pos.tableAddress = this->physicalToVirtual(entry.getOutputAddress());
 					
@@ -165,7 +463,7 @@ private:
 				}
 				case TTLevel::Level1:
 				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level1>(this->readAddress(pos.tableAddress + pos.entryOffset));
+					auto entry = ENTRY_TYPE::template make<GRANULE, TTLevel::Level1>(readTableEntry(pos, address, walkCache));
 					result.descriptor = entry.getDescriptor();
 					
 					// check is entry is valid
@@ -180,6 +478,9 @@ private:
 					if (entry.isTableDescriptor() == false)
 						return result.setType(WalkResultType::Complete).setOutputAddress(entry.getOutputAddress());
 					
+					// save table descriptor for walks sharing the same path
+					walkCache.insert(pos.level, address, entry.getDescriptor());
+					
 					// get next table address
 					pos.tableAddress = this->physicalToVirtual(entry.getOutputAddress());
 					
@@ -187,7 +488,7 @@ private:
 				}
 				case TTLevel::Level2:
 				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level2>(this->readAddress(pos.tableAddress + pos.entryOffset));
+					auto entry = ENTRY_TYPE::template make<GRANULE, TTLevel::Level2>(readTableEntry(pos, address, walkCache));
 					result.descriptor = entry.getDescriptor();
 					
 					// check is entry is valid
@@ -202,6 +503,9 @@ private:
 					if (entry.isTableDescriptor() == false)
 						return result.setType(WalkResultType::Complete).setOutputAddress(entry.getOutputAddress());
 					
+					// save table descriptor for walks sharing the same path
+					walkCache.insert(pos.level, address, entry.getDescriptor());
+					
 					// get next table address
 					pos.tableAddress = this->physicalToVirtual(entry.getOutputAddress());
 					
@@ -209,7 +513,7 @@ private:
 				}
 				case TTLevel::Level3:
 				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level3>(this->readAddress(pos.tableAddress + pos.entryOffset));
+					auto entry = ENTRY_TYPE::template make<GRANULE, TTLevel::Level3>(this->readAddress(pos.tableAddress + pos.entryOffset));
 					result.descriptor = entry.getDescriptor();
 					
 					// check is entry is valid
@@ -240,27 +544,281 @@ private:
 		return result.setType(WalkResultType::Failed).setOutputAddress(kInvalidAddress);
 	}
 	
-	template <TTGranule GRANULE>
-	bool performReverseWalkFrom(virt_addr_t address, WalkerCallback callback)
+	ttentry_t readTableEntry(const WalkPosition& pos, virt_addr_t address, TTWalkCache& walkCache)
+	{
+		ttentry_t descriptor;
+		if (walkCache.lookup(pos.level, address, &descriptor))
+			return descriptor;
+		
+		return this->readAddress(pos.tableAddress + pos.entryOffset);
+	}
+	
+	// Reads count consecutive table entries with single block read if primitives support it
+	void readTableEntries(virt_addr_t address, ttentry_t* entries, size_t count)
+	{
+		if (this->readBlock(address, entries, count * kPlatformAddressSize))
+			return;
+		
+		for (size_t i = 0; i < count; i++)
+			entries[i] = this->readAddress(address + i * kPlatformAddressSize);
+	}
+	
+	virt_addr_t getRegionMask() const
+	{
+		return (virt_addr_t(1) << (kPlatformAddressBits - m_mmuConfig.regionSizeOffset)) - 1;
+	}
+	
+	// Subtree of the table visited by enumeration (table entries mapping region offsets [first, last])
+	struct EnumerateTask
+	{
+		virt_addr_t	tableAddress;
+		TTLevel		level;
+		virt_addr_t	tableOffset;
+		virt_addr_t	first;
+		virt_addr_t	last;
+	};
+	
+	// Mappings collected by one thread, chunks are VA contiguous runs of mappings
+	struct EnumerateChunk
+	{
+		virt_addr_t	address;
+		size_t		begin;
+		size_t		end;
+	};
+	
+	struct EnumerateBuffer
+	{
+		std::vector<TranslationMapping>	mappings;
+		std::vector<EnumerateChunk>		chunks;
+		size_t							chunkBegin = 0;
+		
+		void beginChunk()
+		{
+			chunkBegin = mappings.size();
+		}
+		
+		void endChunk()
+		{
+			if (mappings.size() > chunkBegin)
+				chunks.push_back({ mappings[chunkBegin].virtualAddress, chunkBegin, mappings.size() });
+			chunkBegin = mappings.size();
+		}
+	};
+	
+	template <typename CALLBACK>
+	bool enumerateRegion(virt_addr_t regionBase, virt_addr_t first, virt_addr_t last, CALLBACK& callback)
+	{
+		EnumerateTask task = { m_tableBase, m_mmuConfig.initialLevel, 0, first, last };
+		
+		// whole tree is visited by single task
+		auto split = [] (const EnumerateTask&) -> bool { return false; };
+		
+		return performEnumerate(task, regionBase, callback, split);
+	}
+	
+	bool enumerateRegionParallel(virt_addr_t regionBase, virt_addr_t first, virt_addr_t last,
+								 EnumerateCallback& callback, uint32_t threadCount)
+	{
+		if (this->isThreadSafe() == false)
+			threadCount = 1;
+		
+		// single thread needs no buffering, mappings are passed to callback as they are found
+		if (threadCount == 1)
+			return enumerateRegion(regionBase, first, last, callback);
+		
+		TaskPool<EnumerateTask> pool(threadCount);
+		std::vector<EnumerateBuffer> buffers(pool.getThreadCount());
+		
+		EnumerateTask root = { m_tableBase, m_mmuConfig.initialLevel, 0, first, last };
+		pool.push(0, root);
+		
+		auto worker = [&] (uint32_t threadIndex, const EnumerateTask& task)
+		{
+			EnumerateBuffer& buffer = buffers[threadIndex];
+			
+			auto collect = [&buffer] (const TranslationMapping& mapping) -> WalkOperation
+			{
+				buffer.mappings.push_back(mapping);
+				return WalkOperation::Continue;
+			};
+			
+			// L1 and L2 tables become tasks, mappings before and after them go to separate chunks
+			// L3 tables are too small to pay for queueing and are visited by the same thread
+			auto split = [&] (const EnumerateTask& subtree) -> bool
+			{
+				if (uint32_t(subtree.level) > uint32_t(TTLevel::Level2))
+					return false;
+				
+				buffer.endChunk();
+				pool.push(threadIndex, subtree);
+				return true;
+			};
+			
+			buffer.beginChunk();
+			performEnumerate(task, regionBase, collect, split);
+			buffer.endChunk();
+		};
+		
+		pool.run(worker);
+		
+		// chunks don't overlap so sorting them by address restores VA order
+		std::vector<std::pair<virt_addr_t, std::pair<size_t, size_t>>> order;
+		for (size_t threadIndex = 0; threadIndex < buffers.size(); threadIndex++)
+		{
+			for (size_t chunkIndex = 0; chunkIndex < buffers[threadIndex].chunks.size(); chunkIndex++)
+				order.push_back({ buffers[threadIndex].chunks[chunkIndex].address, { threadIndex, chunkIndex } });
+		}
+		std::sort(order.begin(), order.end());
+		
+		for (auto& item : order)
+		{
+			EnumerateBuffer& buffer = buffers[item.second.first];
+			EnumerateChunk& chunk = buffer.chunks[item.second.second];
+			
+			for (size_t i = chunk.begin; i < chunk.end; i++)
+			{
+				if (callback(buffer.mappings[i]) == WalkOperation::Stop)
+					return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	template <typename CALLBACK, typename SPLIT>
+	bool performEnumerate(const EnumerateTask& task, virt_addr_t regionBase, CALLBACK& callback, SPLIT& split)
+	{
+		switch (m_mmuConfig.granule) {
+			case TTGranule::Granule4K: return performEnumerate<TTGranule::Granule4K>(task, regionBase, callback, split);
+			case TTGranule::Granule16K: return performEnumerate<TTGranule::Granule16K>(task, regionBase, callback, split);
+			case TTGranule::Granule64K: return performEnumerate<TTGranule::Granule64K>(task, regionBase, callback, split);
+				
+			default: assert(0);
+		}
+		
+		return false;
+	}
+	
+	// Depth-first visit of table entries which overlap [first, last], every entry is read once
+	// Invalid entries and their subtrees are skipped, next level tables are visited recursively unless taken by split
+	template <TTGranule GRANULE, typename CALLBACK, typename SPLIT>
+	bool performEnumerate(const EnumerateTask& task, virt_addr_t regionBase, CALLBACK& callback, SPLIT& split)
+	{
+		uint32_t levelShift = GetLevelShift(GRANULE, task.level);
+		uint64_t entrySize = uint64_t(1) << levelShift;
+		
+		// initial level table may have less or more (concatenated) entries
+		uint32_t indexBits = (task.level == m_mmuConfig.initialLevel)?
+			kPlatformAddressBits - m_mmuConfig.regionSizeOffset - levelShift : GetLevelIndexBits(GRANULE);
+		uint64_t lastIndex = (uint64_t(1) << indexBits) - 1;
+		
+		uint64_t index = (task.first > task.tableOffset)? (task.first - task.tableOffset) >> levelShift : 0;
+		lastIndex = std::min(lastIndex, (task.last - task.tableOffset) >> levelShift);
+		
+		// entries are read and scanned in blocks, 16K granule table fits in single block
+		// only entries valid for the level are visited
+		ttentry_t entries[kEnumerateBlockEntries];
+		phys_addr_t outputAddresses[kEnumerateBlockEntries];
+		TTTableScan scan;
+		
+		for (uint64_t blockIndex = index; blockIndex <= lastIndex; blockIndex += kEnumerateBlockEntries)
+		{
+			uint32_t count = uint32_t(std::min<uint64_t>(kEnumerateBlockEntries, lastIndex - blockIndex + 1));
+			readTableEntries(task.tableAddress + blockIndex * kPlatformAddressSize, entries, count);
+			TTTableScanner::scan(GRANULE, task.level, entries, count, &scan, outputAddresses);
+			
+			bool completed = scan.forEach(scan.valid, [&] (uint32_t i) -> bool {
+				phys_addr_t outputAddress = outputAddresses[i];
+				virt_addr_t entryFirst = task.tableOffset + ((blockIndex + i) << levelShift);
+				
+				if (scan.isSet(scan.table, i))
+				{
+					virt_addr_t nextTableAddress = this->physicalToVirtual(outputAddress);
+					if (nextTableAddress == kInvalidAddress)
+						return true;
+					
+					TTLevel nextLevel = task.level;
+					nextLevel++;
+					
+					virt_addr_t entryLast = entryFirst + (entrySize - 1);
+					EnumerateTask subtree = {
+						nextTableAddress, nextLevel, entryFirst, std::max(task.first, entryFirst), std::min(task.last, entryLast)
+					};
+					
+					if (split(subtree))
+						return true;
+					
+					return performEnumerate<GRANULE>(subtree, regionBase, callback, split);
+				}
+				
+				// block or page
+				TranslationMapping mapping = {
+					.virtualAddress = regionBase | entryFirst,
+					.size = entrySize,
+					.outputAddress = outputAddress,
+					.descriptor = entries[i],
+					.level = task.level
+				};
+				
+				return callback(mapping) == WalkOperation::Continue;
+			});
+			
+			if (completed == false)
+				return false;
+		}
+		
+		return true;
+	}
+	
+	static void appendExtent(std::vector<TranslationExtent>& extents, virt_addr_t address, uint64_t size,
+							 phys_addr_t outputAddress, ttentry_t attributes)
+	{
+		if (extents.empty() == false)
+		{
+			TranslationExtent& previous = extents.back();
+			
+			bool isAdjacent = (previous.virtualAddress + previous.size == address);
+			bool isSameType = (previous.isValid() == (outputAddress != kInvalidAddress));
+			bool isContiguous = (previous.isValid() == false) ||
+								(previous.outputAddress + previous.size == outputAddress && previous.attributes == attributes);
+			
+			if (isAdjacent && isSameType && isContiguous)
+			{
+				previous.size += size;
+				return;
+			}
+		}
+		
+		TranslationExtent extent = {
+			.virtualAddress = address,
+			.size = size,
+			.outputAddress = outputAddress,
+			.attributes = attributes
+		};
+		extents.push_back(extent);
+	}
+	
+	template <typename CALLBACK>
+	bool performReverseWalkFrom(virt_addr_t address, CALLBACK& callback)
 	{
 		struct ReverseWalk
 		{
-			uint32_t		levels;
-			WalkPosition	position[uint32_t(TTLevel::Count)];
-			ttentry_t		entry[uint32_t(TTLevel::Count)];
+			uint32_t			levels;
+			WalkPosition		position[uint32_t(TTLevel::Count)];
+			TTDescriptorView	entry[uint32_t(TTLevel::Count)];
 		} walk;
 		
 		walk.levels = 0;
 		
 		// walk forward and save translation lookups
-		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase);
-		WalkResult result = walker.walkTo(address, [&walk] (WalkPosition* position, TTGenericEntry* entry) {
+		TTWalker<PRIMITIVES> walker(m_mmuConfig, m_tableBase, *this);
+		WalkResult result = walker.walkViewTo(address, [&walk] (WalkPosition* position, TTDescriptorView* entry) {
 			// safety checks
 			if (position == nullptr || entry == nullptr)
 				return WalkOperation::Stop;
 			
 			walk.position[walk.levels] = *position;
-			walk.entry[walk.levels] = entry->getDescriptor();
+			walk.entry[walk.levels] = *entry;
 			walk.levels++;
 			
 			return WalkOperation::Continue;
@@ -274,38 +832,8 @@ private:
 		{
 			uint32_t currentLevel = walk.levels - 1;
 			
-			switch (walk.position[currentLevel].level)
-			{
-				case TTLevel::Level0:
-				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level0>(walk.entry[currentLevel]);
-					if (callback(&(walk.position[currentLevel]), &entry) == WalkOperation::Stop)
-						return false;
-					break;
-				}
-				case TTLevel::Level1:
-				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level1>(walk.entry[currentLevel]);
-					if (callback(&(walk.position[currentLevel]), &entry) == WalkOperation::Stop)
-						return false;
-					break;
-				}
-				case TTLevel::Level2:
-				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level2>(walk.entry[currentLevel]);
-					if (callback(&(walk.position[currentLevel]), &entry) == WalkOperation::Stop)
-						return false;
-					break;
-				}
-				case TTLevel::Level3:
-				{
-					auto entry = TTEntry<GRANULE, TTLevel::Level3>(walk.entry[currentLevel]);
-					if (callback(&(walk.position[currentLevel]), &entry) == WalkOperation::Stop)
-						return false;
-					break;
-				}
-				default: assert(0);
-			}
+			if (callback(&(walk.position[currentLevel]), &(walk.entry[currentLevel])) == WalkOperation::Stop)
+				return false;
 			
 			walk.levels--;
 		}
@@ -315,6 +843,11 @@ private:
 	
 private:
 	
+	static const uint32_t kEnumerateBlockEntries = 2048;
+	
 	MMUConfig 	m_mmuConfig;
 	virt_addr_t m_tableBase = kInvalidAddress;
+	
+	TTTranslationCache	m_translationCache;
+	TTWalkCache			m_walkCache;
 };
@@ -13,31 +13,19 @@
 #include "TTWalker.h"
 #include "PageRelocator.h"
 
+// Primitives of the handle they are created for, every C object carries its own set, so
+// handles can be used from multiple threads at once (as long as their callbacks allow it)
 class ttwalkerPrimitives : public Primitives
 {
 public:
 	
-	ttwalkerPrimitives()
-	{
-		if (s_walker)
-		{
-			m_funcReadAddress		= s_walker->read_address;
-			m_funcPhysicalToVirtual = s_walker->physical_to_virtual;
-		}
-	}
+	ttwalkerPrimitives() = delete;
 	
-	static void	init(ttwalker* walker)
-	{
-		if (walker == nullptr)
-			return;
-		
-		s_walker = walker;
-	}
-	
-	static void	close()
-	{
-		s_walker = nullptr;
-	}
+	ttwalkerPrimitives(const ttwalker* walker)
+		:	m_funcReadAddress(walker->read_address),
+			m_funcReadBlock(walker->read_block),
+			m_funcPhysicalToVirtual(walker->physical_to_virtual)
+	{}
 	
 	uintptr_t	readAddress(uintptr_t address)
 	{
@@ -47,6 +35,14 @@ public:
 		return m_funcReadAddress(address);
 	};
 	
+	bool		readBlock(virt_addr_t address, void* dst, size_t size)
+	{
+		if (m_funcReadBlock == nullptr)
+			return false;
+		
+		return m_funcReadBlock(address, dst, size);
+	}
+	
 	virt_addr_t physicalToVirtual(phys_addr_t address)
 	{
 		if (m_funcPhysicalToVirtual == nullptr)
@@ -57,48 +53,29 @@ public:
 	
 private:
 
-	static ttwalker* s_walker;
-	
 	uintptr_t	(*m_funcReadAddress)(virt_addr_t address) = nullptr;
+	bool		(*m_funcReadBlock)(virt_addr_t address, void* dst, size_t size) = nullptr;
 	virt_addr_t (*m_funcPhysicalToVirtual)(phys_addr_t address) = nullptr;
 	
 };
 
-ttwalker* ttwalkerPrimitives::s_walker = nullptr;
-
 class pagerelocatorPrimitives : public Primitives
 {
 public:
 	
-	pagerelocatorPrimitives()
-	{
-		if (s_relocator)
-		{
-			m_funcReadAddress				= s_relocator->read_address;
-			m_funcWriteAddress				= s_relocator->write_address;
-			
-			m_funcCopyInKernel				= s_relocator->copy_in_kernel;
-			
-			m_funcAllocInPhysicalMemory		= s_relocator->alloc_in_physical_memory;
-			m_funcDeallocInPhysicalMemory	= s_relocator->dealloc_in_physical_memory;
-			
-			m_funcPhysicalToVirtual			= s_relocator->physical_to_virtual;
-			m_funcVirtualToPhysical			= s_relocator->virtual_to_physical;
-		}
-	}
-
-	static void	init(pagerelocator* relocator)
-	{
-		if (relocator == nullptr)
-			return;
-		
-		s_relocator = relocator;
-	}
+	pagerelocatorPrimitives() = delete;
 	
-	static void	close()
-	{
-		s_relocator = nullptr;
-	}
+	pagerelocatorPrimitives(const pagerelocator* relocator)
+		:	m_funcReadAddress(relocator->read_address),
+			m_funcReadBlock(relocator->read_block),
+			m_funcWriteAddress(relocator->write_address),
+			m_funcWriteBlock(relocator->write_block),
+			m_funcCopyInKernel(relocator->copy_in_kernel),
+			m_funcAllocInPhysicalMemory(relocator->alloc_in_physical_memory),
+			m_funcDeallocInPhysicalMemory(relocator->dealloc_in_physical_memory),
+			m_funcPhysicalToVirtual(relocator->physical_to_virtual),
+			m_funcVirtualToPhysical(relocator->virtual_to_physical)
+	{}
 
 	uintptr_t	readAddress(virt_addr_t address)
 	{
@@ -107,11 +84,25 @@ public:
 		
 		return m_funcReadAddress(address);
 	}
+	bool		readBlock(virt_addr_t address, void* dst, size_t size)
+	{
+		if (m_funcReadBlock == nullptr)
+			return false;
+		
+		return m_funcReadBlock(address, dst, size);
+	}
 	void		writeAddress(virt_addr_t address, virt_addr_t data)
 	{
 		if (m_funcWriteAddress != nullptr)
 			m_funcWriteAddress(address, data);
 	}
+	bool		writeBlock(virt_addr_t address, const void* src, size_t size)
+	{
+		if (m_funcWriteBlock == nullptr)
+			return false;
+		
+		return m_funcWriteBlock(address, src, size);
+	}
 	
 	void		copyInKernel(virt_addr_t dst, virt_addr_t src, uint32_t size)
 	{
@@ -151,10 +142,10 @@ public:
 	
 private:
 	
-	static pagerelocator* s_relocator;
-	
 	uintptr_t	(*m_funcReadAddress)(virt_addr_t address) = nullptr;
+	bool		(*m_funcReadBlock)(virt_addr_t address, void* dst, size_t size) = nullptr;
 	void		(*m_funcWriteAddress)(virt_addr_t address, virt_addr_t data) = nullptr;
+	bool		(*m_funcWriteBlock)(virt_addr_t address, const void* src, size_t size) = nullptr;
 	
 	void		(*m_funcCopyInKernel)(virt_addr_t dst, virt_addr_t src, uint32_t size) = nullptr;
 	
@@ -166,47 +157,112 @@ private:
 
 };
 
-pagerelocator* pagerelocatorPrimitives::s_relocator = nullptr;
-
-static TTLevel0Entry_4K gLO_4K(kTTDescriptor_TableBit);		// must be table
-static TTLevel1Entry_4K gL1_4K;
-static TTLevel2Entry_4K gL2_4K;
-static TTLevel3Entry_4K gL3_4K(kTTDescriptor_PageBit);		// must be page;
+// Entry details are decoded with TTDescriptorView, no shared entry objects are involved
+static TTDescriptorView GetTTEntryView(const TTEntryDetails* entry)
+{
+	if (entry == nullptr)
+		assert(0);
+	
+	if (entry->granule != TTGranule::Granule4K && entry->granule != TTGranule::Granule16K && entry->granule != TTGranule::Granule64K)
+		assert(0);
+	
+	if (uint32_t(entry->level) >= uint32_t(TTLevel::Count))
+		assert(0);
+	
+	return TTDescriptorView(entry->granule, entry->level, entry->descriptor);
+}
 
-static TTLevel0Entry_16K gLO_16K(kTTDescriptor_TableBit);	// must be table
-static TTLevel1Entry_16K gL1_16K(kTTDescriptor_TableBit);	// must be table
-static TTLevel2Entry_16K gL2_16K;
-static TTLevel3Entry_16K gL3_16K(kTTDescriptor_PageBit);	// must be page;
+static TTDescriptorView GetTTTableEntryView(const TTEntryDetails* entry)
+{
+	auto view = GetTTEntryView(entry);
+	if (view.isTableDescriptor() == false)
+		assert(0);
+	
+	return view;
+}
 
-static TTLevel0Entry_64K gLO_64K(kTTDescriptor_TableBit);	// must be table
-static TTLevel1Entry_64K gL1_64K(kTTDescriptor_TableBit);	// must be table
-static TTLevel2Entry_64K gL2_64K;
-static TTLevel3Entry_64K gL3_64K(kTTDescriptor_PageBit);	// must be page;
+static TTDescriptorView GetTTBlockOrPageEntryView(const TTEntryDetails* entry)
+{
+	auto view = GetTTEntryView(entry);
+	if (view.isBlockDescriptor() == false && view.isPageDescriptor() == false)
+		assert(0);
+	
+	return view;
+}
 
-static TTGenericEntry* gTTEntryObjects[uint32_t(TTGranule::Count)][uint32_t(TTLevel::Count)] = {
-	{	&gLO_4K,	&gL1_4K,	&gL2_4K,	&gL3_4K		},
-	{	&gLO_16K,	&gL1_16K,	&gL2_16K,	&gL3_16K	},
-	{	&gLO_64K,	&gL1_64K,	&gL2_64K,	&gL3_64K	},
-};
+static inline void SetTTEntryBits(TTEntryDetails* entry, ttentry_t mask, ttentry_t shift, ttentry_t value)
+{
+	entry->descriptor = (entry->descriptor & ~mask) | ((value << shift) & mask);
+}
 
-TTGenericEntry* GetTTEntryObject(TTEntryDetails* entry)
+static inline void DecodeTTEntry(const TTDescriptorView& view, TTEntryDecoded* decoded)
 {
-	if (! entry) return nullptr;
-	
-	uint32_t granuleInx;
-	switch (entry->granule)
-	{
-		case TTGranule::Granule4K: granuleInx = 0; break;
-		case TTGranule::Granule16K: granuleInx = 1; break;
-		case TTGranule::Granule64K: granuleInx = 2; break;
-		default: assert(0);
+	ttentry_t descriptor = view.getDescriptor();
+	
+	*decoded = TTEntryDecoded();
+	decoded->descriptor		= descriptor;
+	decoded->outputAddress	= view.getOutputAddress();
+	decoded->isValid		= view.isValid();
+	decoded->isTable		= view.isTableDescriptor();
+	decoded->isBlock		= view.isBlockDescriptor();
+	decoded->isPage			= view.isPageDescriptor();
+	decoded->isReserved		= view.isReserved();
+	
+	if (decoded->isValid == false)
+		return;
+	
+	if (decoded->isTable)
+	{
+		decoded->pxnTable	= (descriptor & kTTDescriptor_PXNTableBitMask) != 0;
+		decoded->xnTable	= (descriptor & kTTDescriptor_XNTableBitMask) != 0;
+		decoded->apTable	= TTDescriptorAPTable((descriptor & kTTDescriptor_APTableBitMask) >> kTTDescriptor_APTableBitShift);
+		decoded->nsTable	= (descriptor & kTTDescriptor_NSTableBitMask) != 0;
+	}
+	else if (decoded->isBlock || decoded->isPage)
+	{
+		decoded->attrIndx	= uint8_t((descriptor & kTTDescriptor_AttrIndxBitMask) >> kTTDescriptor_AttrIndxBitShift);
+		decoded->ns			= (descriptor & kTTDescriptor_NSBitMask) != 0;
+		decoded->ap			= TTDescriptorAP((descriptor & kTTDescriptor_APBitMask) >> kTTDescriptor_APBitShift);
+		decoded->sh			= TTDescriptorSH((descriptor & kTTDescriptor_SHBitMask) >> kTTDescriptor_SHBitShift);
+		decoded->af			= (descriptor & kTTDescriptor_AFBitMask) != 0;
+		decoded->nG			= (descriptor & kTTDescriptor_nGBitMask) != 0;
+		decoded->contiguous	= (descriptor & kTTDescriptor_ContiguousBitMask) != 0;
+		decoded->pxn		= (descriptor & kTTDescriptor_PXNBitMask) != 0;
+		decoded->xn			= (descriptor & kTTDescriptor_XNBitMask) != 0;
 	}
-	uint32_t levelIdx = uint32_t(entry->level);
-	
-	auto entryObj = gTTEntryObjects[granuleInx][levelIdx];
-	entryObj->setDescriptor(entry->descriptor);
+}
+
+// Calls function with walker object of created handle or with temporary walker for the call
+template <typename FUNC>
+static auto CallWalkerObject(ttwalker* walker, FUNC func) -> decltype(func(*(TTWalker<ttwalkerPrimitives>*)nullptr))
+{
+	if (walker->object != nullptr)
+		return func(*(TTWalker<ttwalkerPrimitives>*)walker->object);
 	
-	return entryObj;
+	TTWalker<ttwalkerPrimitives> walkerObj(walker->mmu_config, walker->table_base, ttwalkerPrimitives(walker));
+	return func(walkerObj);
+}
+
+// Wraps C callback to pass entries as TTEntryDetails
+static PageRelocator<pagerelocatorPrimitives>::RelocatorViewCallback GetRelocatorCallback(pagerelocator* relocator, pagerelocator_callback callback)
+{
+	return [callback, relocator] (TTLevel level, const TTDescriptorView* oldEntry, TTDescriptorView* newEntry) -> ttentry_t {
+		assert(oldEntry != nullptr && newEntry != nullptr);
+		TTEntryDetails oldDetails = {
+			.granule	= relocator->mmu_config.granule,
+			.level		= level,
+			.descriptor	= oldEntry->getDescriptor()
+		};
+		TTEntryDetails newDetails = {
+			.granule	= relocator->mmu_config.granule,
+			.level		= level,
+			.descriptor	= newEntry->getDescriptor()
+		};
+		if (callback != nullptr)
+			return callback(level, &oldDetails, &newDetails, relocator->cb_user_data);
+		else
+			return newDetails.descriptor;
+	};
 }
 
 extern "C"
@@ -215,47 +271,27 @@ extern "C"
 	
 	bool ttentry_IsValid(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		return entryObj->isValid();
+		return GetTTEntryView(entry).isValid();
 	}
 
 	bool ttentry_IsBlockDescriptor(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-
-		return entryObj->isBlockDescriptor();
+		return GetTTEntryView(entry).isBlockDescriptor();
 	}
 
 	bool ttentry_IsTableDescriptor(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-
-		return entryObj->isTableDescriptor();
+		return GetTTEntryView(entry).isTableDescriptor();
 	}
 
 	bool ttentry_IsReserved(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-
-		return entryObj->isReserved();
+		return GetTTEntryView(entry).isReserved();
 	}
 
 	bool ttentry_IsPageDescriptor(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-
-		return entryObj->isPageDescriptor();
+		return GetTTEntryView(entry).isPageDescriptor();
 	}
 	
 	ttentry_t	ttentry_GetDescriptor(TTEntryDetails* entry)
@@ -276,371 +312,205 @@ extern "C"
 
 	phys_addr_t ttentry_GetOutputAddress(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		return entryObj->getOutputAddress();
+		return GetTTEntryView(entry).getOutputAddress();
 	}
 	
 	void ttentry_SetOutputAddress(TTEntryDetails* entry, phys_addr_t address)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		entryObj->setOutputAddress(address);
-		entry->descriptor = entryObj->getDescriptor();
+		auto view = GetTTEntryView(entry);
+		view.setOutputAddress(address);
+		entry->descriptor = view.getDescriptor();
 	}
 	
 	// MARK: - ttentry functions (Table Entry)
 	
 	bool		ttentry_GetPXNTable(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_PXNTableBitMask) != 0;
+		return (GetTTTableEntryView(entry).getDescriptor() & kTTDescriptor_PXNTableBitMask) != 0;
 	}
 
 	bool		ttentry_GetXNTable(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_XNTableBitMask) != 0;
+		return (GetTTTableEntryView(entry).getDescriptor() & kTTDescriptor_XNTableBitMask) != 0;
 	}
 
 	TTDescriptorAPTable		ttentry_GetAPTable(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		return TTDescriptorAPTable((entryObj->getDescriptor() & kTTDescriptor_APTableBitMask) >> kTTDescriptor_APTableBitShift);
+		return TTDescriptorAPTable((GetTTTableEntryView(entry).getDescriptor() & kTTDescriptor_APTableBitMask) >> kTTDescriptor_APTableBitShift);
 	}
 
 	bool		ttentry_GetNSTable(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_NSTableBitMask) != 0;
+		return (GetTTTableEntryView(entry).getDescriptor() & kTTDescriptor_NSTableBitMask) != 0;
 	}
 	
 	void		ttentry_SetPXNTable(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_PXNTableBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_PXNTableBitMask;
+		GetTTTableEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_PXNTableBitMask, kTTDescriptor_PXNTableBitShift, value);
 	}
 	
 	void		ttentry_SetXNTable(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_XNTableBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_XNTableBitMask;
+		GetTTTableEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_XNTableBitMask, kTTDescriptor_XNTableBitShift, value);
 	}
 	
 	void		ttentry_SetAPTable(TTEntryDetails* entry, TTDescriptorAPTable value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		entry->descriptor &= ~kTTDescriptor_PXNTableBitMask;
-		entry->descriptor |= (ttentry_t(value) << kTTDescriptor_PXNTableBitShift);
+		GetTTTableEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_APTableBitMask, kTTDescriptor_APTableBitShift, value);
 	}
 	
 	void		ttentry_SetNSTable(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isTableDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_NSTableBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_NSTableBitMask;
+		GetTTTableEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_NSTableBitMask, kTTDescriptor_NSTableBitShift, value);
 	}
 	
 	// MARK: - ttentry functions (Block or Page Entry)
 	
 	uint8_t		ttentry_GetAttrIndx(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return uint8_t((entryObj->getDescriptor() & kTTDescriptor_AttrIndxBitMask) >> kTTDescriptor_AttrIndxBitShift);
+		return uint8_t((GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_AttrIndxBitMask) >> kTTDescriptor_AttrIndxBitShift);
 	}
 	
 	bool		ttentry_GetNS(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_NSBitMask) != 0;
+		return (GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_NSBitMask) != 0;
 	}
 	
 	TTDescriptorAP	ttentry_GetAP(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return TTDescriptorAP((entryObj->getDescriptor() & kTTDescriptor_APBitMask) >> kTTDescriptor_APBitShift);
+		return TTDescriptorAP((GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_APBitMask) >> kTTDescriptor_APBitShift);
 	}
 	
 	TTDescriptorSH	ttentry_GetSH(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return TTDescriptorSH((entryObj->getDescriptor() & kTTDescriptor_SHBitMask) >> kTTDescriptor_SHBitShift);
+		return TTDescriptorSH((GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_SHBitMask) >> kTTDescriptor_SHBitShift);
 	}
 	
 	bool		ttentry_GetAF(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_AFBitMask) != 0;
+		return (GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_AFBitMask) != 0;
 	}
 	
 	bool		ttentry_GetNG(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_nGBitMask) != 0;
+		return (GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_nGBitMask) != 0;
 	}
 	
 	bool		ttentry_GetContiguous(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_ContiguousBitMask) != 0;
+		return (GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_ContiguousBitMask) != 0;
 	}
 	
 	bool		ttentry_GetPXN(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_PXNBitMask) != 0;
+		return (GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_PXNBitMask) != 0;
 	}
 	
 	bool		ttentry_GetXN(TTEntryDetails* entry)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		return (entryObj->getDescriptor() & kTTDescriptor_XNBitMask) != 0;
+		return (GetTTBlockOrPageEntryView(entry).getDescriptor() & kTTDescriptor_XNBitMask) != 0;
 	}
 
-	
 	void		ttentry_SetAttrIndx(TTEntryDetails* entry, uint8_t value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		entry->descriptor &= ~kTTDescriptor_AttrIndxBitMask;
-		entry->descriptor |= (ttentry_t(value) << kTTDescriptor_AttrIndxBitShift);
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_AttrIndxBitMask, kTTDescriptor_AttrIndxBitShift, value);
 	}
 	
 	void		ttentry_SetNS(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_NSBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_NSBitMask;
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_NSBitMask, kTTDescriptor_NSBitShift, value);
 	}
 
 	void		ttentry_SetAP(TTEntryDetails* entry, TTDescriptorAP value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		entry->descriptor &= ~kTTDescriptor_APBitMask;
-		entry->descriptor |= (ttentry_t(value) << kTTDescriptor_APBitShift);
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_APBitMask, kTTDescriptor_APBitShift, value);
 	}
 
 	void		ttentry_SetSH(TTEntryDetails* entry, TTDescriptorSH value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		entry->descriptor &= ~kTTDescriptor_SHBitMask;
-		entry->descriptor |= (ttentry_t(value) << kTTDescriptor_SHBitShift);
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_SHBitMask, kTTDescriptor_SHBitShift, value);
 	}
 
 	void		ttentry_SetAF(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_AFBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_AFBitMask;
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_AFBitMask, kTTDescriptor_AFBitShift, value);
 	}
 
 	void		ttentry_SetNG(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_nGBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_nGBitMask;
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_nGBitMask, kTTDescriptor_nGBitShift, value);
 	}
 
 	void		ttentry_SetContiguous(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
-		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
-			assert(0);
-		
-		if (value)
-			entry->descriptor |= kTTDescriptor_ContiguousBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_ContiguousBitMask;
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_ContiguousBitMask, kTTDescriptor_ContiguousBitShift, value);
 	}
 
 	void		ttentry_SetPXN(TTEntryDetails* entry, bool value)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_PXNBitMask, kTTDescriptor_PXNBitShift, value);
+	}
+
+	void		ttentry_SetXN(TTEntryDetails* entry, bool value)
+	{
+		GetTTBlockOrPageEntryView(entry);
+		SetTTEntryBits(entry, kTTDescriptor_XNBitMask, kTTDescriptor_XNBitShift, value);
+	}
+	
+	// MARK: - ttentry functions (Batch decoding)
+	
+	void		ttentry_Decode(const TTEntryDetails* entry, TTEntryDecoded* decoded)
+	{
+		if (decoded == nullptr)
 			assert(0);
 		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
+		DecodeTTEntry(GetTTEntryView(entry), decoded);
+	}
+	
+	void		ttentry_DecodeArray(const TTEntryDetails* entries, size_t count, TTEntryDecoded* decoded)
+	{
+		if (count == 0)
+			return;
+		
+		if (entries == nullptr || decoded == nullptr)
 			assert(0);
 		
-		if (value)
-			entry->descriptor |= kTTDescriptor_PXNBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_PXNBitMask;
+		for (size_t i = 0; i < count; i++)
+			DecodeTTEntry(GetTTEntryView(&entries[i]), &decoded[i]);
 	}
-
-	void		ttentry_SetXN(TTEntryDetails* entry, bool value)
+	
+	void		ttentry_DecodeTable(TTGranule granule, TTLevel level, const ttentry_t* descriptors, size_t count, TTEntryDecoded* decoded)
 	{
-		auto entryObj = GetTTEntryObject(entry);
-		if (entryObj == nullptr)
-			assert(0);
+		if (count == 0)
+			return;
 		
-		if (entryObj->isBlockDescriptor() == false && entryObj->isPageDescriptor() == false)
+		if (descriptors == nullptr || decoded == nullptr)
 			assert(0);
 		
-		if (value)
-			entry->descriptor |= kTTDescriptor_XNBitMask;
-		else
-			entry->descriptor &= ~kTTDescriptor_XNBitMask;
+		// granule and level are checked once, view is only rebound to every descriptor
+		TTEntryDetails details = { .granule = granule, .level = level, .descriptor = 0 };
+		TTDescriptorView view = GetTTEntryView(&details);
+		
+		for (size_t i = 0; i < count; i++)
+		{
+			view.setDescriptor(descriptors[i]);
+			DecodeTTEntry(view, &decoded[i]);
+		}
 	}
 	
+	
 	// MARK: - MMU Config
 	
 	void		mmuconfig_Init(mmuconfigparser* configparser)
@@ -698,24 +568,21 @@ extern "C"
 		if (walker == nullptr)
 			return result.setType(WalkResultType::Failed);
 		
-		ttwalkerPrimitives::init(walker);
-		
-		TTWalker<ttwalkerPrimitives> walkerObj(walker->mmu_config, walker->table_base);
-		result = walkerObj.walkTo(address, [callback, walker] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
-			assert(position != nullptr && entry != nullptr);
-			TTEntryDetails details = {
-				.granule	= walker->mmu_config.granule,
-				.level		= position->level,
-				.descriptor	= entry->getDescriptor()
-			};
-			if (callback != nullptr)
-				return callback(position, &details, walker->cb_user_data);
-			else
-				return WalkOperation::Continue;
+		result = CallWalkerObject(walker, [callback, walker, address] (TTWalker<ttwalkerPrimitives>& walkerObj) -> WalkResult {
+			return walkerObj.walkTo(address, [callback, walker] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+				assert(position != nullptr && entry != nullptr);
+				TTEntryDetails details = {
+					.granule	= walker->mmu_config.granule,
+					.level		= position->level,
+					.descriptor	= entry->getDescriptor()
+				};
+				if (callback != nullptr)
+					return callback(position, &details, walker->cb_user_data);
+				else
+					return WalkOperation::Continue;
+			});
 		});
 		
-		ttwalkerPrimitives::close();
-		
 		return result;
 	}
 	
@@ -726,24 +593,21 @@ extern "C"
 		if (walker == nullptr)
 			return false;
 		
-		ttwalkerPrimitives::init(walker);
-		
-		TTWalker<ttwalkerPrimitives> walkerObj(walker->mmu_config, walker->table_base);
-		result = walkerObj.reverseWalkFrom(address, [callback, walker] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
-			assert(position != nullptr && entry != nullptr);
-			TTEntryDetails details = {
-				.granule	= walker->mmu_config.granule,
-				.level		= position->level,
-				.descriptor	= entry->getDescriptor()
-			};
-			if (callback != nullptr)
-				return callback(position, &details, walker->cb_user_data);
-			else
-				return WalkOperation::Continue;
+		result = CallWalkerObject(walker, [callback, walker, address] (TTWalker<ttwalkerPrimitives>& walkerObj) -> bool {
+			return walkerObj.reverseWalkFrom(address, [callback, walker] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+				assert(position != nullptr && entry != nullptr);
+				TTEntryDetails details = {
+					.granule	= walker->mmu_config.granule,
+					.level		= position->level,
+					.descriptor	= entry->getDescriptor()
+				};
+				if (callback != nullptr)
+					return callback(position, &details, walker->cb_user_data);
+				else
+					return WalkOperation::Continue;
+			});
 		});
 		
-		ttwalkerPrimitives::close();
-		
 		return result;
 	}
 	
@@ -752,15 +616,90 @@ extern "C"
 		if (walker == nullptr)
 			return kInvalidAddress;
 		
-		ttwalkerPrimitives::init(walker);
+		phys_addr_t result = CallWalkerObject(walker, [address] (TTWalker<ttwalkerPrimitives>& walkerObj) -> phys_addr_t {
+			return walkerObj.findPhysicalAddress(address);
+		});
 		
-		TTWalker<ttwalkerPrimitives> walkerObj(walker->mmu_config, walker->table_base);
+		return result;
+	}
+	
+	void ttwalker_TranslateBatch(ttwalker* walker, const virt_addr_t* in, phys_addr_t* out, size_t count)
+	{
+		if (walker == nullptr)
+			return;
 		
-		phys_addr_t result = walkerObj.findPhysicalAddress(address);
+		CallWalkerObject(walker, [in, out, count] (TTWalker<ttwalkerPrimitives>& walkerObj) {
+			walkerObj.translateBatch(in, out, count);
+		});
+	}
+	
+	void ttwalker_Create(ttwalker* walker, uint32_t tlb_sets, uint32_t tlb_ways, uint32_t walk_cache_entries)
+	{
+		if (walker == nullptr)
+			return;
 		
-		ttwalkerPrimitives::close();
+		ttwalker_Destroy(walker);
 		
-		return result;
+		auto walkerObj = new TTWalker<ttwalkerPrimitives>(walker->mmu_config, walker->table_base, ttwalkerPrimitives(walker));
+		if (tlb_sets != 0 && tlb_ways != 0)
+			walkerObj->enableTranslationCache(tlb_sets, tlb_ways);
+		if (walk_cache_entries != 0)
+			walkerObj->enableWalkCache(walk_cache_entries);
+		
+		walker->object = (void*)walkerObj;
+	}
+	
+	void ttwalker_Invalidate(ttwalker* walker, virt_addr_t address)
+	{
+		if (walker == nullptr)
+			return;
+		
+		if (walker->object == nullptr)
+			return;
+		
+		auto walkerObj = (TTWalker<ttwalkerPrimitives>*)walker->object;
+		walkerObj->invalidateTranslation(address);
+		walkerObj->invalidateWalkCache(address);
+	}
+	
+	void ttwalker_InvalidateAll(ttwalker* walker)
+	{
+		if (walker == nullptr)
+			return;
+		
+		if (walker->object == nullptr)
+			return;
+		
+		auto walkerObj = (TTWalker<ttwalkerPrimitives>*)walker->object;
+		walkerObj->invalidateAllTranslations();
+		walkerObj->invalidateAllWalkCache();
+	}
+	
+	ttwalker_stats ttwalker_GetStats(ttwalker* walker)
+	{
+		ttwalker_stats stats = {};
+		
+		if (walker == nullptr)
+			return stats;
+		
+		if (walker->object == nullptr)
+			return stats;
+		
+		auto walkerObj = (TTWalker<ttwalkerPrimitives>*)walker->object;
+		stats.translation_cache = walkerObj->getTranslationCacheStats();
+		stats.walk_cache = walkerObj->getWalkCacheStats();
+		
+		return stats;
+	}
+	
+	void ttwalker_Destroy(ttwalker* walker)
+	{
+		if (walker == nullptr)
+			return;
+		
+		auto walkerObj = (TTWalker<ttwalkerPrimitives>*)walker->object;
+		delete walkerObj;
+		walker->object = nullptr;
 	}
  
 	// MARK: - pagerelocator functions
@@ -770,10 +709,9 @@ extern "C"
 		if (relocator == nullptr)
 			return;
 		
-		pagerelocatorPrimitives::init(relocator);
-		
-		auto relocatorObj = new PageRelocator<pagerelocatorPrimitives>(relocator->mmu_config, relocator->table_base);
+		auto relocatorObj = new PageRelocator<pagerelocatorPrimitives>(relocator->mmu_config, relocator->table_base, pagerelocatorPrimitives(relocator));
 		relocator->object = (void*)relocatorObj;
+		relocator->journal = nullptr;
 	}
 	
 	bool pagerelocator_RelocatePage(pagerelocator* relocator, virt_addr_t address, pagerelocator_callback callback)
@@ -800,25 +738,19 @@ extern "C"
 			return false;
 
 		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
-		return relocatorObj->preparePageRelocationFor(address, [callback, relocator] (TTLevel level,
-																					  TTGenericEntry* oldEntry,
-																					  TTGenericEntry* newEntry) -> ttentry_t {
-			assert(oldEntry != nullptr && newEntry != nullptr);
-			TTEntryDetails oldDetails = {
-				.granule	= relocator->mmu_config.granule,
-				.level		= level,
-				.descriptor	= oldEntry->getDescriptor()
-			};
-			TTEntryDetails newDetails = {
-				.granule	= relocator->mmu_config.granule,
-				.level		= level,
-				.descriptor	= newEntry->getDescriptor()
-			};
-			if (callback != nullptr)
-				return callback(level, &oldDetails, &newDetails, relocator->cb_user_data);
-			else
-				return newDetails.descriptor;
-		});
+		return relocatorObj->preparePageRelocationFor(address, GetRelocatorCallback(relocator, callback));
+	}
+	
+	bool		pagerelocator_RelocateRange(pagerelocator* relocator, virt_addr_t begin, virt_addr_t end, pagerelocator_callback callback)
+	{
+		if (relocator == nullptr)
+			return false;
+		
+		if (relocator->object == nullptr)
+			return false;
+		
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		return relocatorObj->relocateRange(begin, end, GetRelocatorCallback(relocator, callback));
 	}
 	
 	bool		pagerelocator_CompleteRelocation(pagerelocator* relocator)
@@ -833,6 +765,18 @@ extern "C"
 		return relocatorObj->completeRelocation();
 	}
 	
+	bool		pagerelocator_CompleteRelocations(pagerelocator* relocator)
+	{
+		if (relocator == nullptr)
+			return false;
+		
+		if (relocator->object == nullptr)
+			return false;
+		
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		return relocatorObj->completeRelocations();
+	}
+	
 	bool		pagerelocator_CancelRelocation(pagerelocator* relocator)
 	{
 		if (relocator == nullptr)
@@ -845,6 +789,18 @@ extern "C"
 		return relocatorObj->cancelRelocation();
 	}
 	
+	bool		pagerelocator_CancelRelocations(pagerelocator* relocator)
+	{
+		if (relocator == nullptr)
+			return false;
+		
+		if (relocator->object == nullptr)
+			return false;
+	
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		return relocatorObj->cancelRelocations();
+	}
+	
 	bool pagerelocator_RestorePage(pagerelocator* relocator, virt_addr_t address)
 	{
 		if (relocator == nullptr)
@@ -857,6 +813,75 @@ extern "C"
 		return relocatorObj->restorePageFor(address);
 	}
 	
+	void pagerelocator_EnablePagePool(pagerelocator* relocator, uint32_t chunk_pages, uint32_t low_watermark, uint32_t high_watermark)
+	{
+		if (relocator == nullptr)
+			return;
+		
+		if (relocator->object == nullptr)
+			return;
+		
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		relocatorObj->enablePagePool(chunk_pages, low_watermark, high_watermark);
+	}
+	
+	void pagerelocator_SetLazyPageCopy(pagerelocator* relocator, bool lazy)
+	{
+		if (relocator == nullptr)
+			return;
+		
+		if (relocator->object == nullptr)
+			return;
+		
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		relocatorObj->setLazyPageCopy(lazy);
+	}
+	
+	bool pagerelocator_MarkPageWritten(pagerelocator* relocator, virt_addr_t address, size_t size)
+	{
+		if (relocator == nullptr)
+			return false;
+		
+		if (relocator->object == nullptr)
+			return false;
+		
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		return relocatorObj->markPageWritten(address, size);
+	}
+	
+	bool pagerelocator_OpenJournal(pagerelocator* relocator, const char* path)
+	{
+		if (relocator == nullptr)
+			return false;
+		
+		if (relocator->object == nullptr || relocator->journal != nullptr)
+			return false;
+		
+		auto journal = new RelocationJournal();
+		auto relocatorObj = (PageRelocator<pagerelocatorPrimitives>*)relocator->object;
+		if (journal->open(path) == false || relocatorObj->recoverFromJournal(*journal) == false)
+		{
+			relocatorObj->setJournal(nullptr);
+			delete journal;
+			return false;
+		}
+		
+		relocator->journal = (void*)journal;
+		return true;
+	}
+	
+	bool pagerelocator_FlushJournal(pagerelocator* relocator, bool sync)
+	{
+		if (relocator == nullptr)
+			return false;
+		
+		if (relocator->journal == nullptr)
+			return false;
+		
+		auto journal = (RelocationJournal*)relocator->journal;
+		return journal->flush(sync);
+	}
+	
 	void pagerelocator_Close(pagerelocator* relocator)
 	{
 		if (relocator == nullptr)
@@ -866,6 +891,9 @@ extern "C"
 		delete relocatorObj;
 		relocator->object = nullptr;
 		
-		pagerelocatorPrimitives::close();
+		// buffered records are flushed on close
+		auto journal = (RelocationJournal*)relocator->journal;
+		delete journal;
+		relocator->journal = nullptr;
 	}
 }
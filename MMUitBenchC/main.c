@@ -0,0 +1,369 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "MMUit.h"
+
+// MARK: - MMU emulation
+
+// Physical memory is a heap allocated arena, VA of the page is a pointer to arena content
+// LEVEL 1 -> LEVEL 2 -> LEVEL 3 (kBenchL2Entries tables) -> PAGE (kBenchL3Entries per table)
+// Mapped pages are located after the arena and have no content, only tables are backed by memory.
+
+#define kBenchPageSize			(4 * 1024)
+#define kBenchEntries			(kBenchPageSize / kPlatformAddressSize)
+#define kBenchL2Entries			256
+#define kBenchL3Entries			kBenchEntries
+#define kBenchMappedPages		(kBenchL2Entries * kBenchL3Entries)
+#define kBenchArenaPages		(1 + 1 + kBenchL2Entries)
+
+#define kBenchPhysicalBase		0x800000000ULL
+
+#define kBenchIterations		1000000
+#define kBenchBatchSize			64
+#define kBenchMaxThreads		16
+#define kBenchWorkingSet		512
+
+static virt_addr_t	gArenaBase = 0;
+static uint32_t		gNextPage = 0;
+
+// MARK: - Primitives
+
+uintptr_t	read_address(virt_addr_t address)
+{
+	return *(ttentry_t*)address;
+}
+
+bool		read_block(virt_addr_t address, void* dst, size_t size)
+{
+	memcpy(dst, (const void*)address, size);
+	return true;
+}
+
+virt_addr_t	physical_to_virtual(phys_addr_t address)
+{
+	return gArenaBase + (address - kBenchPhysicalBase);
+}
+
+phys_addr_t	virtual_to_physical(virt_addr_t address)
+{
+	return kBenchPhysicalBase + (address - gArenaBase);
+}
+
+virt_addr_t	alloc_page()
+{
+	assert(gNextPage < kBenchArenaPages);
+	return gArenaBase + (gNextPage++) * kBenchPageSize;
+}
+
+// Builds tables mapping kBenchMappedPages pages from VA 0, returns VA of L1 table
+virt_addr_t BuildBenchTables()
+{
+	void* arena = NULL;
+	int err = posix_memalign(&arena, kBenchPageSize, (size_t)kBenchArenaPages * kBenchPageSize);
+	assert(err == 0);
+	memset(arena, 0, (size_t)kBenchArenaPages * kBenchPageSize);
+
+	gArenaBase = (virt_addr_t)arena;
+	gNextPage = 0;
+
+	virt_addr_t l1Table = alloc_page();
+	virt_addr_t l2Table = alloc_page();
+	*(ttentry_t*)l1Table = virtual_to_physical(l2Table) | kTTDescriptor_TableBit | kTTDescriptor_ValidBit;
+
+	for (uint32_t l2 = 0; l2 < kBenchL2Entries; l2++)
+	{
+		virt_addr_t l3Table = alloc_page();
+		((ttentry_t*)l2Table)[l2] = virtual_to_physical(l3Table) | kTTDescriptor_TableBit | kTTDescriptor_ValidBit;
+
+		for (uint32_t l3 = 0; l3 < kBenchL3Entries; l3++)
+		{
+			phys_addr_t page = kBenchPhysicalBase + ((uint64_t)kBenchArenaPages + l2 * kBenchL3Entries + l3) * kBenchPageSize;
+			((ttentry_t*)l3Table)[l3] = page | kTTDescriptor_AFBitMask | kTTDescriptor_PageBit | kTTDescriptor_ValidBit;
+		}
+	}
+
+	return l1Table;
+}
+
+// Scatters iterations over the whole mapping, different threads touch different pages
+virt_addr_t GetBenchVA(uint64_t index)
+{
+	uint64_t page = (index * 7919) % kBenchMappedPages;
+	return page * kBenchPageSize + (index % kBenchEntries) * kPlatformAddressSize;
+}
+
+phys_addr_t GetBenchPA(virt_addr_t address)
+{
+	return kBenchPhysicalBase + (uint64_t)kBenchArenaPages * kBenchPageSize + address;
+}
+
+// MARK: - Timing
+
+uint64_t GetTimeNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Thread count is appended to the name unless it is zero
+void PrintResult(const char* name, uint32_t threads, uint64_t elapsed, uint64_t iterations)
+{
+	char label[64];
+	if (threads != 0)
+		snprintf(label, sizeof(label), "%s (%u threads)", name, threads);
+	else
+		snprintf(label, sizeof(label), "%s", name);
+	printf("  %-40s %10.1f ns/op (%llu ops)\n", label, (double)elapsed / iterations, (unsigned long long)iterations);
+}
+
+// MARK: - Cached walker
+
+// Translates addresses of kBenchWorkingSet pages over and over (like repeated lookups of hot kernel objects)
+void RunWorkingSetBench(const char* name, ttwalker* walker)
+{
+	uint64_t mismatches = 0;
+	uint64_t start = GetTimeNs();
+
+	for (uint64_t i = 0; i < kBenchIterations; i++)
+	{
+		virt_addr_t vaddr = GetBenchVA(i % kBenchWorkingSet);
+		if (ttwalker_FindPhysicalAddress(walker, vaddr) != GetBenchPA(vaddr))
+			mismatches++;
+	}
+
+	PrintResult(name, 0, GetTimeNs() - start, kBenchIterations);
+
+	assert(mismatches == 0);
+}
+
+// MARK: - Entry decoding
+
+// Decodes every L3 table with one accessor call per field, returns number of valid entries
+uint64_t DecodeWithAccessors(ttentry_t* const* tables, uint32_t tableCount)
+{
+	uint64_t valid = 0;
+	uint64_t checksum = 0;
+
+	for (uint32_t t = 0; t < tableCount; t++)
+	{
+		for (uint32_t e = 0; e < kBenchEntries; e++)
+		{
+			TTEntryDetails entry = { kTTGranule4K, kTTLevel3, tables[t][e] };
+			if (ttentry_IsValid(&entry) == false || ttentry_IsPageDescriptor(&entry) == false)
+				continue;
+
+			valid++;
+			checksum += ttentry_GetOutputAddress(&entry) + ttentry_GetAttrIndx(&entry) + ttentry_GetAP(&entry) + ttentry_GetAF(&entry) + ttentry_GetXN(&entry);
+		}
+	}
+
+	return (checksum != 0)? valid : 0;
+}
+
+// Same as above with one ttentry_DecodeTable call per table
+uint64_t DecodeWithTable(ttentry_t* const* tables, uint32_t tableCount)
+{
+	TTEntryDecoded decoded[kBenchEntries];
+	uint64_t valid = 0;
+	uint64_t checksum = 0;
+
+	for (uint32_t t = 0; t < tableCount; t++)
+	{
+		ttentry_DecodeTable(kTTGranule4K, kTTLevel3, tables[t], kBenchEntries, decoded);
+
+		for (uint32_t e = 0; e < kBenchEntries; e++)
+		{
+			if (decoded[e].isValid == false || decoded[e].isPage == false)
+				continue;
+
+			valid++;
+			checksum += decoded[e].outputAddress + decoded[e].attrIndx + decoded[e].ap + decoded[e].af + decoded[e].xn;
+		}
+	}
+
+	return (checksum != 0)? valid : 0;
+}
+
+// MARK: - Workers
+
+typedef struct {
+	ttwalker*	walker;
+	bool		batch;
+	uint64_t	first;
+	uint64_t	count;
+	uint64_t	mismatches;
+} BenchWorker;
+
+void* bench_worker(void* arg)
+{
+	BenchWorker* worker = (BenchWorker*)arg;
+
+	if (worker->batch == false)
+	{
+		for (uint64_t i = worker->first; i < worker->first + worker->count; i++)
+		{
+			virt_addr_t vaddr = GetBenchVA(i);
+			if (ttwalker_FindPhysicalAddress(worker->walker, vaddr) != GetBenchPA(vaddr))
+				worker->mismatches++;
+		}
+	}
+	else
+	{
+		virt_addr_t batchVA[kBenchBatchSize];
+		phys_addr_t batchPA[kBenchBatchSize];
+
+		for (uint64_t i = worker->first; i < worker->first + worker->count; i += kBenchBatchSize)
+		{
+			size_t count = (size_t)(worker->first + worker->count - i);
+			if (count > kBenchBatchSize)
+				count = kBenchBatchSize;
+
+			for (size_t b = 0; b < count; b++)
+				batchVA[b] = GetBenchVA(i + b);
+
+			ttwalker_TranslateBatch(worker->walker, batchVA, batchPA, count);
+
+			for (size_t b = 0; b < count; b++)
+				if (batchPA[b] != GetBenchPA(batchVA[b]))
+					worker->mismatches++;
+		}
+	}
+
+	return NULL;
+}
+
+// Splits kBenchIterations between threads, every thread uses its own handle unless shared is set
+void RunParallelBench(const char* name, ttwalker* walker, uint32_t threads, bool shared, bool batch)
+{
+	pthread_t	tids[kBenchMaxThreads];
+	ttwalker	handles[kBenchMaxThreads];
+	BenchWorker	workers[kBenchMaxThreads];
+
+	uint64_t perThread = kBenchIterations / threads;
+
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		handles[t] = *walker;
+
+		workers[t].walker = shared ? walker : &handles[t];
+		workers[t].batch = batch;
+		workers[t].first = t * perThread;
+		workers[t].count = perThread;
+		workers[t].mismatches = 0;
+	}
+
+	uint64_t start = GetTimeNs();
+
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		int err = pthread_create(&tids[t], NULL, bench_worker, &workers[t]);
+		assert(err == 0);
+	}
+
+	uint64_t mismatches = 0;
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		pthread_join(tids[t], NULL);
+		mismatches += workers[t].mismatches;
+	}
+
+	PrintResult(name, threads, GetTimeNs() - start, perThread * threads);
+
+	assert(mismatches == 0);
+}
+
+// MARK: - Benchmarks
+
+int main(int argc, const char * argv[])
+{
+	// 4K granule, 36 bit region starting at L1
+	MMUConfig mmuConfig = {
+		.granule = kTTGranule4K,
+		.initial_level = kTTLevel1,
+		.region_size_offset = 28
+	};
+
+	ttwalker walker = {0};
+	walker.mmu_config = mmuConfig;
+	walker.table_base = BuildBenchTables();
+	walker.read_address = read_address;
+	walker.read_block = read_block;
+	walker.physical_to_virtual = physical_to_virtual;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t maxThreads = (cpus < 2) ? 2 : (cpus > kBenchMaxThreads) ? kBenchMaxThreads : (uint32_t)cpus;
+
+	printf("\n*** BENCH ttwalker_FindPhysicalAddress() parallel\n");
+
+	for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		RunParallelBench("per thread handle", &walker, threads, false, false);
+		RunParallelBench("shared handle", &walker, threads, true, false);
+	}
+
+	printf("\n*** BENCH ttwalker_TranslateBatch() parallel\n");
+
+	for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		RunParallelBench("per thread handle", &walker, threads, false, true);
+		RunParallelBench("shared handle", &walker, threads, true, true);
+	}
+
+	printf("\n*** BENCH ttwalker_Create()\n");
+
+	{
+		RunWorkingSetBench("stateless handle", &walker);
+
+		ttwalker cachedWalker = walker;
+		ttwalker_Create(&cachedWalker, 0, 0, 64);
+		RunWorkingSetBench("walk cache", &cachedWalker);
+		ttwalker_Destroy(&cachedWalker);
+
+		ttwalker_Create(&cachedWalker, 256, 4, 64);
+		RunWorkingSetBench("TLB + walk cache", &cachedWalker);
+
+		ttwalker_stats stats = ttwalker_GetStats(&cachedWalker);
+		printf("  TLB: %llu hits, %llu misses, walk cache: %llu hits, %llu misses\n",
+			   (unsigned long long)stats.translation_cache.hits, (unsigned long long)stats.translation_cache.misses,
+			   (unsigned long long)stats.walk_cache.hits, (unsigned long long)stats.walk_cache.misses);
+		ttwalker_Destroy(&cachedWalker);
+	}
+
+	printf("\n*** BENCH ttentry decoding\n");
+
+	{
+		ttentry_t* tables[kBenchL2Entries];
+		ttentry_t* l2Table = (ttentry_t*)physical_to_virtual(((ttentry_t*)walker.table_base)[0] & ~(ttentry_t)(kBenchPageSize - 1));
+		for (uint32_t l2 = 0; l2 < kBenchL2Entries; l2++)
+			tables[l2] = (ttentry_t*)physical_to_virtual(l2Table[l2] & ~(ttentry_t)(kBenchPageSize - 1));
+
+		uint64_t valid;
+		uint64_t start = GetTimeNs();
+		valid = DecodeWithAccessors(tables, kBenchL2Entries);
+		PrintResult("accessors (per field)", 0, GetTimeNs() - start, kBenchMappedPages);
+		assert(valid == kBenchMappedPages);
+
+		start = GetTimeNs();
+		valid = DecodeWithTable(tables, kBenchL2Entries);
+		PrintResult("ttentry_DecodeTable()", 0, GetTimeNs() - start, kBenchMappedPages);
+		assert(valid == kBenchMappedPages);
+	}
+
+	free((void*)gArenaBase);
+
+	return 0;
+}
@@ -0,0 +1,726 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#include "MMUit.hpp"
+#include "VMAKit/TTEntry.h"
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// MARK: - MMU emulation
+
+// Physical memory is an anonymous memory mapped arena, VA of the page is a pointer to arena content
+// LEVEL 1 -> LEVEL 2 -> LEVEL 3 (kBenchL2Entries tables) -> PAGE (kBenchL3Entries per table)
+// Mapped pages are located after the arena and have no content, only tables are backed by memory.
+// Pages allocated for relocated pages get no content either, so only touched arena pages are committed.
+
+const TTGranule	kBenchGranule = TTGranule::Granule4K;
+const uint32_t	kBenchPageSize = uint32_t(kBenchGranule);
+const uint32_t	kBenchEntries = kBenchPageSize / kPlatformAddressSize;
+const uint32_t	kBenchL2Entries = 256;
+const uint32_t	kBenchL3Entries = kBenchEntries;
+const uint32_t	kBenchRelocatedPages = 100000;
+const uint32_t	kBenchPoolPages = 4 * PhysicalPagePool<Primitives>::kDefaultChunkPages;
+const uint32_t	kBenchArenaPages = 2 * (1 + 1 + kBenchL2Entries) + kBenchRelocatedPages + kBenchPoolPages;
+
+const phys_addr_t kBenchPhysicalBase = 0x800000000;
+
+const uint64_t	kBenchIterations = 1000000;
+
+class BenchPrimitives : public Primitives
+{
+public:
+
+	static void	init()
+	{
+		if (s_arenaBase == 0)
+		{
+			void* arena = mmap(nullptr, size_t(kBenchArenaPages) * kBenchPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+			assert(arena != MAP_FAILED);
+			s_arenaBase = virt_addr_t(arena);
+		}
+
+		s_nextPage = 0;
+		s_freePages.clear();
+	}
+
+	uintptr_t	readAddress(virt_addr_t address)
+	{
+		return *(ttentry_t*)address;
+	}
+
+	bool		readBlock(virt_addr_t address, void* dst, size_t size)
+	{
+		memcpy(dst, (const void*)address, size);
+		return true;
+	}
+
+	void		writeAddress(virt_addr_t address, virt_addr_t data)
+	{
+		s_writes++;
+		*(ttentry_t*)address = data;
+	}
+
+	bool		writeBlock(virt_addr_t address, const void* src, size_t size)
+	{
+		s_writes++;
+		memcpy((void*)address, src, size);
+		return true;
+	}
+
+	void		copyInKernel(virt_addr_t dst, virt_addr_t src, uint32_t size)
+	{
+		// mapped pages outside of the arena have no content
+		if (isArenaAddress(src))
+			memcpy((void*)dst, (const void*)src, size);
+	}
+
+	virt_addr_t allocInPhysicalMemory(uint32_t size)
+	{
+		s_allocations++;
+
+		// free pages are reused for single page allocations only
+		uint32_t pages = (size + kBenchPageSize - 1) / kBenchPageSize;
+		if (pages == 1 && s_freePages.empty() == false)
+		{
+			virt_addr_t page = s_freePages.back();
+			s_freePages.pop_back();
+			return page;
+		}
+
+		assert(s_nextPage + pages <= kBenchArenaPages);
+		virt_addr_t address = s_arenaBase + s_nextPage * kBenchPageSize;
+		s_nextPage += pages;
+
+		return address;
+	}
+
+	bool		deallocInPhysicalMemory(virt_addr_t address, uint32_t size)
+	{
+		s_allocations++;
+
+		for (uint32_t offset = 0; offset < size; offset += kBenchPageSize)
+			s_freePages.push_back(address + offset);
+		return true;
+	}
+
+	bool		isThreadSafe()
+	{
+		return true;
+	}
+
+	phys_addr_t virtualToPhysical(virt_addr_t address)
+	{
+		return kBenchPhysicalBase + (address - s_arenaBase);
+	}
+
+	virt_addr_t physicalToVirtual(phys_addr_t address)
+	{
+		return s_arenaBase + (address - kBenchPhysicalBase);
+	}
+
+private:
+
+	bool		isArenaAddress(virt_addr_t address)
+	{
+		return address >= s_arenaBase && address < s_arenaBase + kBenchArenaPages * kBenchPageSize;
+	}
+
+private:
+
+	static virt_addr_t				s_arenaBase;
+	
+public:
+	
+	// number of writeAddress and writeBlock calls
+	static uint64_t					s_writes;
+	// number of allocInPhysicalMemory and deallocInPhysicalMemory calls
+	static uint64_t					s_allocations;
+	
+private:
+	
+	static uint32_t					s_nextPage;
+	static std::vector<virt_addr_t>	s_freePages;
+};
+
+virt_addr_t				BenchPrimitives::s_arenaBase;
+uint64_t				BenchPrimitives::s_writes;
+uint64_t				BenchPrimitives::s_allocations;
+uint32_t				BenchPrimitives::s_nextPage;
+std::vector<virt_addr_t> BenchPrimitives::s_freePages;
+
+// Builds tables mapping kBenchL2Entries * kBenchL3Entries pages from VA 0, returns VA of L1 table
+virt_addr_t BuildBenchTables(BenchPrimitives& primitives)
+{
+	BenchPrimitives::init();
+
+	virt_addr_t l1Table = primitives.allocInPhysicalMemory(kBenchPageSize);
+	virt_addr_t l2Table = primitives.allocInPhysicalMemory(kBenchPageSize);
+	primitives.writeAddress(l1Table, primitives.virtualToPhysical(l2Table) | kTTDescriptor_TableBit | kTTDescriptor_ValidBit);
+
+	for (uint32_t l2 = 0; l2 < kBenchL2Entries; l2++)
+	{
+		virt_addr_t l3Table = primitives.allocInPhysicalMemory(kBenchPageSize);
+		primitives.writeAddress(l2Table + l2 * kPlatformAddressSize, primitives.virtualToPhysical(l3Table) | kTTDescriptor_TableBit | kTTDescriptor_ValidBit);
+
+		for (uint32_t l3 = 0; l3 < kBenchL3Entries; l3++)
+		{
+			phys_addr_t page = kBenchPhysicalBase + (kBenchArenaPages + l2 * kBenchL3Entries + l3) * kBenchPageSize;
+			primitives.writeAddress(l3Table + l3 * kPlatformAddressSize, page | kTTDescriptor_AFBitMask | kTTDescriptor_PageBit | kTTDescriptor_ValidBit);
+		}
+	}
+
+	return l1Table;
+}
+
+virt_addr_t GetBenchPageVA(uint64_t index)
+{
+	return (index % (kBenchL2Entries * kBenchL3Entries)) * kBenchPageSize;
+}
+
+// 16K granule starting at L1 with 39 bit region (iOS TTBR1 regime), tables are taken from the same arena
+// LEVEL 1 -> LEVEL 2 -> LEVEL 3 (kBench16KL2Entries tables) -> PAGE (kBench16KEntries per table)
+
+const TTGranule	kBench16KGranule = TTGranule::Granule16K;
+const uint32_t	kBench16KPageSize = uint32_t(kBench16KGranule);
+const uint32_t	kBench16KEntries = kBench16KPageSize / kPlatformAddressSize;
+const uint32_t	kBench16KL2Entries = 16;
+const uint32_t	kBench16KRegionSizeOffset = 25;
+
+// Arena is reset, so tables built by BuildBenchTables are lost
+virt_addr_t BuildBench16KTables(BenchPrimitives& primitives)
+{
+	BenchPrimitives::init();
+
+	// arena starts at 16K aligned physical address and tables are allocated in 16K chunks, so they stay aligned
+	phys_addr_t pageBase = (kBenchPhysicalBase + phys_addr_t(kBenchArenaPages) * kBenchPageSize + kBench16KPageSize - 1) & ~phys_addr_t(kBench16KPageSize - 1);
+
+	virt_addr_t l1Table = primitives.allocInPhysicalMemory(kBench16KPageSize);
+	virt_addr_t l2Table = primitives.allocInPhysicalMemory(kBench16KPageSize);
+	primitives.writeAddress(l1Table, primitives.virtualToPhysical(l2Table) | kTTDescriptor_TableBit | kTTDescriptor_ValidBit);
+
+	for (uint32_t l2 = 0; l2 < kBench16KL2Entries; l2++)
+	{
+		virt_addr_t l3Table = primitives.allocInPhysicalMemory(kBench16KPageSize);
+		primitives.writeAddress(l2Table + l2 * kPlatformAddressSize, primitives.virtualToPhysical(l3Table) | kTTDescriptor_TableBit | kTTDescriptor_ValidBit);
+
+		for (uint32_t l3 = 0; l3 < kBench16KEntries; l3++)
+		{
+			phys_addr_t page = pageBase + phys_addr_t(l2 * kBench16KEntries + l3) * kBench16KPageSize;
+			primitives.writeAddress(l3Table + l3 * kPlatformAddressSize, page | kTTDescriptor_AFBitMask | kTTDescriptor_PageBit | kTTDescriptor_ValidBit);
+		}
+	}
+
+	return l1Table;
+}
+
+virt_addr_t GetBench16KPageVA(uint64_t index)
+{
+	return (index % (kBench16KL2Entries * kBench16KEntries)) * kBench16KPageSize;
+}
+
+// MARK: - Heap allocation counter
+
+// benches with worker threads allocate too
+static std::atomic<uint64_t> gHeapAllocations(0);
+
+// operators are not inlined, so compiler doesn't pair malloc and free with operator new and delete of callers
+__attribute__((noinline))
+void* operator new(size_t size)
+{
+	gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	
+	void* data = malloc(size);
+	if (data == nullptr)
+		throw std::bad_alloc();
+	
+	return data;
+}
+
+__attribute__((noinline))
+void operator delete(void* data) noexcept
+{
+	free(data);
+}
+
+__attribute__((noinline))
+void operator delete(void* data, size_t) noexcept
+{
+	free(data);
+}
+
+// MARK: - Timing
+
+class BenchTimer
+{
+public:
+
+	BenchTimer(const char* name, uint64_t iterations)
+		: m_name(name), m_iterations(iterations), m_start(std::chrono::steady_clock::now())
+	{}
+
+	~BenchTimer()
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+		printf("  %-40s %10.1f ns/op (%llu ops)\n", m_name, double(elapsed) / m_iterations, (unsigned long long)m_iterations);
+	}
+
+private:
+
+	const char*	m_name;
+	uint64_t	m_iterations;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+// MARK: - Benchmarks
+
+int main(int argc, const char * argv[])
+{
+	// 4K granule, 36 bit region starting at L1
+	MMUConfig mmuConfig = {
+		.granule = kBenchGranule,
+		.initialLevel = TTLevel::Level1,
+		.regionSizeOffset = 28
+	};
+
+	BenchPrimitives primitives;
+	virt_addr_t tableBase = BuildBenchTables(primitives);
+
+	TTWalker<BenchPrimitives> walker(mmuConfig, tableBase, primitives);
+
+	printf("\n*** BENCH walkTo()\n");
+
+	{
+		TTGenericWalker& genericWalker = walker;
+		uint64_t levels = 0;
+		TTGenericWalker::WalkerCallback callback = [&levels] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+			levels++;
+			return WalkOperation::Continue;
+		};
+
+		BenchTimer timer("std::function callback (virtual)", kBenchIterations);
+		for (uint64_t i = 0; i < kBenchIterations; i++)
+			genericWalker.walkTo(GetBenchPageVA(i), callback);
+
+		assert(levels == kBenchIterations * 3);
+	}
+
+	{
+		uint64_t levels = 0;
+
+		BenchTimer timer("template callback", kBenchIterations);
+		for (uint64_t i = 0; i < kBenchIterations; i++)
+		{
+			walker.walkTo(GetBenchPageVA(i), [&levels] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+				levels++;
+				return WalkOperation::Continue;
+			});
+		}
+
+		assert(levels == kBenchIterations * 3);
+	}
+
+	{
+		uint64_t levels = 0;
+
+		BenchTimer timer("template callback (TTDescriptorView)", kBenchIterations);
+		for (uint64_t i = 0; i < kBenchIterations; i++)
+		{
+			walker.walkViewTo(GetBenchPageVA(i), [&levels] (WalkPosition* position, TTDescriptorView* entry) -> WalkOperation {
+				levels += entry->isValid();
+				return WalkOperation::Continue;
+			});
+		}
+
+		assert(levels == kBenchIterations * 3);
+	}
+
+	{
+		phys_addr_t checksum = 0;
+
+		BenchTimer timer("findPhysicalAddress", kBenchIterations);
+		for (uint64_t i = 0; i < kBenchIterations; i++)
+			checksum += walker.findPhysicalAddress(GetBenchPageVA(i));
+
+		assert(checksum != 0);
+	}
+
+	printf("\n*** BENCH TTTableScanner\n");
+
+	{
+		const uint32_t kScanRounds = 100;
+
+		// copies of all LEVEL 3 tables
+		virt_addr_t l2Table = primitives.physicalToVirtual(primitives.readAddress(tableBase) & ~ttentry_t(kBenchPageSize - 1));
+		std::vector<ttentry_t> tables(kBenchL2Entries * kBenchL3Entries);
+		for (uint32_t l2 = 0; l2 < kBenchL2Entries; l2++)
+		{
+			virt_addr_t l3Table = primitives.physicalToVirtual(primitives.readAddress(l2Table + l2 * kPlatformAddressSize) & ~ttentry_t(kBenchPageSize - 1));
+			primitives.readBlock(l3Table, &tables[l2 * kBenchL3Entries], kBenchPageSize);
+		}
+
+		TTTableScan scan;
+		std::vector<phys_addr_t> outputAddresses(kBenchL3Entries);
+
+		{
+			uint64_t pages = 0;
+
+			// same bitmaps and addresses built with TTGenericEntry queries
+			BenchTimer timer("TTGenericEntry per entry (per table)", kScanRounds * kBenchL2Entries);
+			for (uint32_t round = 0; round < kScanRounds; round++)
+			{
+				for (uint32_t l2 = 0; l2 < kBenchL2Entries; l2++)
+				{
+					memset(&scan, 0, sizeof(scan));
+					scan.count = kBenchL3Entries;
+
+					for (uint32_t i = 0; i < kBenchL3Entries; i++)
+					{
+						TTEntrySnapshot entry(TTDescriptorView(kBenchGranule, TTLevel::Level3, tables[l2 * kBenchL3Entries + i]));
+						uint64_t bit = uint64_t(1) << (i % 64);
+
+						ttentry_t descriptor = entry->getDescriptor();
+
+						scan.valid[i / 64] |= (entry->isValid())? bit : 0;
+						scan.page[i / 64] |= (entry->isPageDescriptor())? bit : 0;
+						scan.af[i / 64] |= (descriptor & kTTDescriptor_AFBitMask)? bit : 0;
+						scan.pxn[i / 64] |= (descriptor & kTTDescriptor_PXNBitMask)? bit : 0;
+						scan.xn[i / 64] |= (descriptor & kTTDescriptor_XNBitMask)? bit : 0;
+						outputAddresses[i] = entry->getOutputAddress();
+					}
+
+					pages += scan.countOf(scan.page);
+				}
+			}
+
+			assert(pages == uint64_t(kScanRounds) * tables.size());
+		}
+
+		const TTScanKernel kernels[] = { TTScanKernel::Scalar, TTScanKernel::SSE2, TTScanKernel::AVX2, TTScanKernel::NEON };
+		const char* kernelNames[] = { "scan Scalar (per table)", "scan SSE2 (per table)", "scan AVX2 (per table)", "scan NEON (per table)" };
+
+		for (uint32_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+		{
+			if (TTTableScanner::isKernelSupported(kernels[k]) == false)
+				continue;
+
+			uint64_t pages = 0;
+
+			BenchTimer timer(kernelNames[k], kScanRounds * kBenchL2Entries);
+			for (uint32_t round = 0; round < kScanRounds; round++)
+			{
+				for (uint32_t l2 = 0; l2 < kBenchL2Entries; l2++)
+				{
+					TTTableScanner::scan(kBenchGranule, TTLevel::Level3, &tables[l2 * kBenchL3Entries], kBenchL3Entries,
+										 &scan, outputAddresses.data(), kernels[k]);
+					pages += scan.countOf(scan.page);
+				}
+			}
+
+			assert(pages == uint64_t(kScanRounds) * tables.size());
+		}
+	}
+
+	{
+		uint64_t mappings = 0;
+
+		BenchTimer timer("enumerateMappings (per mapping)", kBenchL2Entries * kBenchL3Entries);
+		walker.enumerateMappings([&mappings] (const TranslationMapping& mapping) -> WalkOperation {
+			mappings++;
+			return WalkOperation::Continue;
+		});
+
+		assert(mappings == kBenchL2Entries * kBenchL3Entries);
+	}
+
+	printf("\n*** BENCH enumerateMappingsParallel()\n");
+
+	{
+		// LEVEL 2 table is shared by several LEVEL 1 entries, so enumeration has one L2 subtree task per entry
+		const uint32_t kAliasedL1Entries = 8;
+		const uint64_t kMappings = uint64_t(kAliasedL1Entries) * kBenchL2Entries * kBenchL3Entries;
+
+		ttentry_t l2Descriptor = primitives.readAddress(tableBase);
+		for (uint32_t l1 = 1; l1 < kAliasedL1Entries; l1++)
+			primitives.writeAddress(tableBase + l1 * kPlatformAddressSize, l2Descriptor);
+
+		{
+			uint64_t mappings = 0;
+
+			BenchTimer timer("enumerateMappings (per mapping)", kMappings);
+			walker.enumerateMappings([&mappings] (const TranslationMapping&) -> WalkOperation {
+				mappings++;
+				return WalkOperation::Continue;
+			});
+
+			assert(mappings == kMappings);
+		}
+
+		const uint32_t threadCounts[] = { 1, 2, 4, 8 };
+		const char* threadNames[] = { "1 thread (per mapping)", "2 threads (per mapping)", "4 threads (per mapping)", "8 threads (per mapping)" };
+
+		for (uint32_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++)
+		{
+			uint64_t mappings = 0;
+			virt_addr_t lastAddress = 0;
+
+			BenchTimer timer(threadNames[t], kMappings);
+			walker.enumerateMappingsParallel([&mappings, &lastAddress] (const TranslationMapping& mapping) -> WalkOperation {
+				assert(mappings == 0 || mapping.virtualAddress > lastAddress);
+				lastAddress = mapping.virtualAddress;
+				mappings++;
+				return WalkOperation::Continue;
+			}, 0, threadCounts[t]);
+
+			assert(mappings == kMappings);
+		}
+
+		for (uint32_t l1 = 1; l1 < kAliasedL1Entries; l1++)
+			primitives.writeAddress(tableBase + l1 * kPlatformAddressSize, 0);
+	}
+
+	printf("\n*** BENCH relocatePageFor()\n");
+	
+	{
+		const uint64_t kRelocations = 100000;
+		PageRelocator<BenchPrimitives> relocator(mmuConfig, tableBase, primitives);
+		
+		// warm up allocator free list and relocation bookkeeping
+		relocator.relocatePageFor(GetBenchPageVA(0));
+		relocator.restorePageFor(GetBenchPageVA(0));
+		
+		uint64_t heapAllocations = gHeapAllocations;
+		{
+			BenchTimer timer("relocatePageFor + restorePageFor", kRelocations);
+			for (uint64_t i = 0; i < kRelocations; i++)
+			{
+				relocator.relocatePageFor(GetBenchPageVA(i));
+				relocator.restorePageFor(GetBenchPageVA(i));
+			}
+		}
+		printf("  %-40s %10.1f\n", "heap allocations per relocation", double(gHeapAllocations - heapAllocations) / kRelocations);
+	}
+
+	{
+		// relocated pages are accumulated, so lookups are made against up to kBenchRelocatedPages pages
+		PageRelocator<BenchPrimitives> relocator(mmuConfig, tableBase, primitives);
+		relocator.reserveRelocations(kBenchRelocatedPages);
+		
+		{
+			BenchTimer timer("relocatePageFor (accumulated)", kBenchRelocatedPages);
+			for (uint64_t i = 0; i < kBenchRelocatedPages; i++)
+				relocator.relocatePageFor(GetBenchPageVA(i));
+		}
+		
+		{
+			uint64_t relocated = 0;
+			
+			BenchTimer timer("isPageRelocatedFor", kBenchIterations);
+			for (uint64_t i = 0; i < kBenchIterations; i++)
+				relocated += relocator.isPageRelocatedFor(GetBenchPageVA(i));
+			
+			assert(relocated != 0);
+		}
+		
+		{
+			BenchTimer timer("restorePageFor (accumulated)", kBenchRelocatedPages);
+			for (uint64_t i = 0; i < kBenchRelocatedPages; i++)
+				relocator.restorePageFor(GetBenchPageVA(i));
+		}
+	}
+	
+	printf("\n*** BENCH relocateRange()\n");
+	
+	{
+		// 2MB range is mapped by one leaf table
+		const uint64_t kRangeIterations = 100;
+		virt_addr_t rangeBegin = GetBenchPageVA(kBenchL3Entries);
+		virt_addr_t rangeEnd = GetBenchPageVA(2 * kBenchL3Entries);
+		
+		PageRelocator<BenchPrimitives> relocator(mmuConfig, tableBase, primitives);
+		relocator.reserveRelocations(kBenchL3Entries);
+		
+		// restore is the same for both cases and is included into timing, writes are counted for relocation only
+		uint64_t writes = 0;
+		{
+			BenchTimer timer("relocatePageFor (per page)", kRangeIterations * kBenchL3Entries);
+			for (uint64_t i = 0; i < kRangeIterations; i++)
+			{
+				uint64_t initialWrites = BenchPrimitives::s_writes;
+				for (virt_addr_t page = rangeBegin; page < rangeEnd; page += kBenchPageSize)
+					relocator.relocatePageFor(page);
+				writes += BenchPrimitives::s_writes - initialWrites;
+				
+				for (virt_addr_t page = rangeBegin; page < rangeEnd; page += kBenchPageSize)
+					relocator.restorePageFor(page);
+			}
+		}
+		printf("  %-40s %10.1f\n", "writes per range", double(writes) / kRangeIterations);
+		
+		writes = 0;
+		{
+			BenchTimer timer("relocateRange", kRangeIterations * kBenchL3Entries);
+			for (uint64_t i = 0; i < kRangeIterations; i++)
+			{
+				uint64_t initialWrites = BenchPrimitives::s_writes;
+				bool result = relocator.relocateRange(rangeBegin, rangeEnd);
+				assert(result);
+				writes += BenchPrimitives::s_writes - initialWrites;
+				
+				for (virt_addr_t page = rangeBegin; page < rangeEnd; page += kBenchPageSize)
+					relocator.restorePageFor(page);
+			}
+		}
+		printf("  %-40s %10.1f\n", "writes per range", double(writes) / kRangeIterations);
+	}
+	
+	printf("\n*** BENCH enablePagePool()\n");
+	
+	{
+		// relocation of 16 pages spread over different leaf tables and their restore
+		const uint64_t kChurnIterations = 10000;
+		const uint32_t kChurnPages = 16;
+		
+		for (uint32_t pool = 0; pool < 2; pool++)
+		{
+			PageRelocator<BenchPrimitives> relocator(mmuConfig, tableBase, primitives);
+			if (pool)
+				relocator.enablePagePool();
+			
+			uint64_t allocations = BenchPrimitives::s_allocations;
+			{
+				BenchTimer timer(pool? "relocate/restore (pool)" : "relocate/restore (primitives)", kChurnIterations * kChurnPages);
+				for (uint64_t i = 0; i < kChurnIterations; i++)
+				{
+					for (uint32_t page = 0; page < kChurnPages; page++)
+						relocator.relocatePageFor(GetBenchPageVA(page * kBenchL3Entries + i));
+					
+					for (uint32_t page = 0; page < kChurnPages; page++)
+						relocator.restorePageFor(GetBenchPageVA(page * kBenchL3Entries + i));
+				}
+			}
+			printf("  %-40s %10.4f\n", "primitive calls per relocation", double(BenchPrimitives::s_allocations - allocations) / (kChurnIterations * kChurnPages));
+		}
+	}
+	
+	printf("\n*** BENCH RelocationJournal\n");
+	
+	{
+		char journalPath[] = "/tmp/mmuit-bench-journal-XXXXXX";
+		close(mkstemp(journalPath));
+		
+		RelocationJournal journal;
+		bool result = journal.open(journalPath);
+		assert(result);
+		
+		{
+			PageRelocator<BenchPrimitives> relocator(mmuConfig, tableBase, primitives);
+			relocator.reserveRelocations(kBenchRelocatedPages);
+			relocator.setJournal(&journal);
+			
+			// records are flushed once per leaf table
+			{
+				BenchTimer timer("relocatePageFor (journal)", kBenchRelocatedPages);
+				for (uint64_t i = 0; i < kBenchRelocatedPages; i++)
+				{
+					relocator.relocatePageFor(GetBenchPageVA(i));
+					if ((i + 1) % kBenchL3Entries == 0)
+						journal.flush();
+				}
+				journal.flush();
+			}
+		}
+		
+		{
+			// relocator above ends without restoring pages
+			PageRelocator<BenchPrimitives> relocator(mmuConfig, tableBase, primitives);
+			relocator.reserveRelocations(kBenchRelocatedPages);
+			
+			{
+				BenchTimer timer("recoverFromJournal (per page)", kBenchRelocatedPages);
+				result = relocator.recoverFromJournal(journal);
+				assert(result);
+			}
+			
+			{
+				BenchTimer timer("restorePageFor (journal)", kBenchRelocatedPages);
+				for (uint64_t i = 0; i < kBenchRelocatedPages; i++)
+					relocator.restorePageFor(GetBenchPageVA(i));
+				journal.flush();
+			}
+		}
+		
+		unlink(journalPath);
+	}
+	
+	printf("\n*** BENCH StaticTTWalker (16K, L1)\n");
+	
+	{
+		MMUConfig mmuConfig16K = {
+			.granule = kBench16KGranule,
+			.initialLevel = TTLevel::Level1,
+			.regionSizeOffset = kBench16KRegionSizeOffset
+		};
+		
+		virt_addr_t tableBase16K = BuildBench16KTables(primitives);
+		
+		TTWalker<BenchPrimitives> dynamicWalker(mmuConfig16K, tableBase16K, primitives);
+		StaticTTWalker<kBench16KGranule, TTLevel::Level1, kBench16KRegionSizeOffset, BenchPrimitives> staticWalker(tableBase16K, primitives);
+		
+		phys_addr_t dynamicChecksum = 0, staticChecksum = 0;
+		
+		{
+			BenchTimer timer("findPhysicalAddress (TTWalker)", kBenchIterations);
+			for (uint64_t i = 0; i < kBenchIterations; i++)
+				dynamicChecksum += dynamicWalker.findPhysicalAddress(GetBench16KPageVA(i));
+		}
+		
+		{
+			BenchTimer timer("findPhysicalAddress (StaticTTWalker)", kBenchIterations);
+			for (uint64_t i = 0; i < kBenchIterations; i++)
+				staticChecksum += staticWalker.findPhysicalAddress(GetBench16KPageVA(i));
+		}
+		
+		assert(dynamicChecksum != 0 && dynamicChecksum == staticChecksum);
+		
+		uint64_t dynamicLevels = 0, staticLevels = 0;
+		
+		{
+			BenchTimer timer("walkViewTo (TTWalker)", kBenchIterations);
+			for (uint64_t i = 0; i < kBenchIterations; i++)
+			{
+				dynamicWalker.walkViewTo(GetBench16KPageVA(i), [&dynamicLevels] (WalkPosition* position, TTDescriptorView* entry) -> WalkOperation {
+					dynamicLevels += entry->isValid();
+					return WalkOperation::Continue;
+				});
+			}
+		}
+		
+		{
+			BenchTimer timer("walkViewTo (StaticTTWalker)", kBenchIterations);
+			for (uint64_t i = 0; i < kBenchIterations; i++)
+			{
+				staticWalker.walkViewTo(GetBench16KPageVA(i), [&staticLevels] (WalkPosition* position, TTDescriptorView* entry) -> WalkOperation {
+					staticLevels += entry->isValid();
+					return WalkOperation::Continue;
+				});
+			}
+		}
+		
+		assert(dynamicLevels == kBenchIterations * 3 && staticLevels == dynamicLevels);
+	}
+	
+	return 0;
+}
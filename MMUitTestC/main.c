@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #include "MMUit.h"
 
@@ -323,6 +324,135 @@ int main(int argc, const char * argv[])
 	reverseResult = ttwalker_ReverseWalk(&walker, vaddr, reversewalk_callback);
 	assert(reverseResult == true);
 
+	printf("\n*** TEST translateBatch()\n");
+	
+	virt_addr_t batchVA[] = {
+		MakeVA(E0, E3, E1, E2, 3),
+		MakeVA(E0, E1, E2, E1, 0),
+		MakeVA(E0, E1, E3, E3, 1),
+		MakeVA(E0, E2, E0, E0, 0),	// not mapped
+		MakeVA(E0, E1, E2, E1, 2),
+		MakeVA(E0, E3, E0, E0, 2),
+	};
+	const size_t batchCount = sizeof(batchVA) / sizeof(batchVA[0]);
+	phys_addr_t batchPA[sizeof(batchVA) / sizeof(batchVA[0])];
+	
+	ttwalker_TranslateBatch(&walker, batchVA, batchPA, batchCount);
+	for (size_t i = 0; i < batchCount; i++)
+	{
+		printf("[%zu] 0x%.16llX -> 0x%.16llX\n", i, batchVA[i], batchPA[i]);
+		assert(batchPA[i] == ttwalker_FindPhysicalAddress(&walker, batchVA[i]));
+	}
+	assert(batchPA[3] == kInvalidAddress);
+
+	printf("\n*** TEST ttwalker_Create()\n");
+	
+	ttwalker cachedWalker = walker;
+	ttwalker_Create(&cachedWalker, 4, 2, 4);
+	
+	// second pass hits translation cache, walk cache is filled by the first one
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		for (size_t i = 0; i < batchCount; i++)
+			assert(ttwalker_FindPhysicalAddress(&cachedWalker, batchVA[i]) == batchPA[i]);
+	}
+	
+	ttwalker_stats walkerStats = ttwalker_GetStats(&cachedWalker);
+	printf("TLB:  %llu hits, %llu misses\n", walkerStats.translation_cache.hits, walkerStats.translation_cache.misses);
+	printf("Walk: %llu hits, %llu misses\n", walkerStats.walk_cache.hits, walkerStats.walk_cache.misses);
+	// [1] and [4] share page, unmapped [3] is not cached and misses on both passes
+	assert(walkerStats.translation_cache.hits == batchCount);
+	assert(walkerStats.translation_cache.misses == batchCount);
+	assert(walkerStats.walk_cache.hits != 0);
+	
+	walkResult = ttwalker_Walk(&cachedWalker, MakeVA(E0, E1, E3, E3, 0), NULL);
+	assert(walkResult.type == kWalkResultType_Complete && walkResult.outputAddress == ttwalker_FindPhysicalAddress(&walker, MakeVA(E0, E1, E3, E3, 0)));
+	
+	ttwalker_InvalidateAll(&cachedWalker);
+	assert(ttwalker_FindPhysicalAddress(&cachedWalker, batchVA[0]) == batchPA[0]);
+	assert(ttwalker_GetStats(&cachedWalker).translation_cache.misses == walkerStats.translation_cache.misses + 1);
+	
+	ttwalker_Destroy(&cachedWalker);
+	assert(cachedWalker.object == NULL);
+
+	printf("\n*** TEST ttentry_DecodeArray()\n");
+	
+	TTEntryDetails decodeEntries[] = {
+		{ kTTGranule4K,	kTTLevel1,	TestTables[1][1] },	// table
+		{ kTTGranule4K,	kTTLevel2,	0x0060000080200741 | kTTDescriptor_ValidBit },	// block
+		{ kTTGranule4K,	kTTLevel3,	0x0040000080003F4B | kTTDescriptor_PageBit },	// page
+		{ kTTGranule4K,	kTTLevel3,	0x0000000080003001 },	// reserved
+		{ kTTGranule16K,	kTTLevel2,	0xB800000080004003 },	// table
+		{ kTTGranule64K,	kTTLevel3,	0x0020000080010403 },	// page
+		{ kTTGranule4K,	kTTLevel2,	0 },	// invalid
+	};
+	const size_t decodeCount = sizeof(decodeEntries) / sizeof(decodeEntries[0]);
+	TTEntryDecoded decoded[sizeof(decodeEntries) / sizeof(decodeEntries[0])];
+	
+	ttentry_DecodeArray(decodeEntries, decodeCount, decoded);
+	for (size_t i = 0; i < decodeCount; i++)
+	{
+		TTEntryDetails* entry = &decodeEntries[i];
+		printf("[%zu] 0x%.16llX -> %c%c%c%c 0x%.16llX\n", i, entry->descriptor,
+			   (decoded[i].isValid)? 'v' : '-',
+			   (decoded[i].isTable)? 't' : '-',
+			   (decoded[i].isBlock)? 'b' : '-',
+			   (decoded[i].isPage)? 'p' : '-',
+			   decoded[i].outputAddress);
+		
+		assert(decoded[i].descriptor == entry->descriptor);
+		assert(decoded[i].outputAddress == ttentry_GetOutputAddress(entry));
+		assert(decoded[i].isValid == ttentry_IsValid(entry));
+		assert(decoded[i].isTable == ttentry_IsTableDescriptor(entry));
+		assert(decoded[i].isBlock == ttentry_IsBlockDescriptor(entry));
+		assert(decoded[i].isPage == ttentry_IsPageDescriptor(entry));
+		assert(decoded[i].isReserved == ttentry_IsReserved(entry));
+		
+		if (decoded[i].isValid && decoded[i].isTable)
+		{
+			assert(decoded[i].pxnTable == ttentry_GetPXNTable(entry));
+			assert(decoded[i].xnTable == ttentry_GetXNTable(entry));
+			assert(decoded[i].apTable == ttentry_GetAPTable(entry));
+			assert(decoded[i].nsTable == ttentry_GetNSTable(entry));
+		}
+		else if (decoded[i].isValid && (decoded[i].isBlock || decoded[i].isPage))
+		{
+			assert(decoded[i].attrIndx == ttentry_GetAttrIndx(entry));
+			assert(decoded[i].ns == ttentry_GetNS(entry));
+			assert(decoded[i].ap == ttentry_GetAP(entry));
+			assert(decoded[i].sh == ttentry_GetSH(entry));
+			assert(decoded[i].af == ttentry_GetAF(entry));
+			assert(decoded[i].nG == ttentry_GetNG(entry));
+			assert(decoded[i].contiguous == ttentry_GetContiguous(entry));
+			assert(decoded[i].pxn == ttentry_GetPXN(entry));
+			assert(decoded[i].xn == ttentry_GetXN(entry));
+		}
+	}
+	assert(decoded[0].isTable && decoded[1].isBlock && decoded[2].isPage && decoded[3].isReserved);
+	assert(decoded[4].isTable && decoded[4].xnTable && decoded[4].apTable == kAPTable_NoEL0ReadAccess);
+	assert(decoded[5].isPage && decoded[5].af && decoded[5].outputAddress == 0x80010000);
+	assert(decoded[6].isValid == false && decoded[6].outputAddress == kInvalidAddress);
+	
+	// raw table descriptors decode the same way as details
+	ttentry_t pageDescriptors[] = { decodeEntries[2].descriptor, decodeEntries[3].descriptor };
+	TTEntryDecoded tableDecoded[2];
+	ttentry_DecodeTable(kTTGranule4K, kTTLevel3, pageDescriptors, 2, tableDecoded);
+	assert(memcmp(&tableDecoded[0], &decoded[2], sizeof(TTEntryDecoded)) == 0);
+	assert(memcmp(&tableDecoded[1], &decoded[3], sizeof(TTEntryDecoded)) == 0);
+	
+	// AP table setter must not touch other table attributes (APTable is bits [62:61])
+	TTEntryDetails tableEntry = decodeEntries[4];
+	for (uint32_t ap = kAPTable_NoEffect; ap <= kAPTable_NoEL0ReadAndAnyWriteAccess; ap++)
+	{
+		ttentry_SetAPTable(&tableEntry, (TTDescriptorAPTable)ap);
+		assert(ttentry_GetAPTable(&tableEntry) == (TTDescriptorAPTable)ap);
+		assert(ttentry_GetPXNTable(&tableEntry) == decoded[4].pxnTable && ttentry_GetXNTable(&tableEntry) == decoded[4].xnTable);
+		assert((tableEntry.descriptor & ~(3ULL << 61)) == (decodeEntries[4].descriptor & ~(3ULL << 61)));
+		assert(((tableEntry.descriptor >> 61) & 3) == ap);
+	}
+	ttentry_SetAPTable(&tableEntry, decoded[4].apTable);
+	assert(tableEntry.descriptor == decodeEntries[4].descriptor);
+
 	printf("\n*** TEST relocatePageFor()\n");
 
 	vaddr = MakeVA(E0, E1, E3, E3, 0);
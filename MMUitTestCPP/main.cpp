@@ -8,7 +8,12 @@
 
 #include "MMUit.hpp"
 
+#include <atomic>
 #include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 // MARK: - MMU emulation
 
@@ -90,6 +95,8 @@ ttentry_t TestTables[19][4] = {
 
 // MARK: - MyPrimitives class
 
+std::atomic<uint32_t> gBlockReads(0);
+
 class MyPrimitives : public Primitives
 {
 public:
@@ -99,6 +106,18 @@ public:
 		return TestTables[GetLevelIndex(address)][GetEntryIndex(address)];
 	};
 	
+	bool		readBlock(virt_addr_t address, void* dst, size_t size)
+	{
+		// used by enumeration to read entries of the table at once
+		gBlockReads++;
+		
+		ttentry_t* entries = (ttentry_t*)dst;
+		for (size_t i = 0; i < size / kPlatformAddressSize; i++)
+			entries[i] = readAddress(address + i * kPlatformAddressSize);
+		
+		return true;
+	}
+	
 	void		writeAddress(virt_addr_t address, virt_addr_t data)
 	{
 		// address here is actually physical to simplify emulation
@@ -114,6 +133,12 @@ public:
 		TestTables[GetLevelIndex(dst)][GetEntryIndex(dst) + 3] = TestTables[GetLevelIndex(src)][GetEntryIndex(src) + 3];
 	}
 	
+	bool		isThreadSafe()
+	{
+		// tables are only read by parallel enumeration
+		return true;
+	}
+	
 	virt_addr_t allocInPhysicalMemory(uint32_t size)
 	{
 		static uint32_t freePage = 14;
@@ -199,6 +224,92 @@ public:
 
 };
 
+// MARK: - ArenaPrimitives class
+
+// Physical memory backed by arena of 4K pages, VA is a pointer to arena content
+const uint32_t kArenaPages = 96;
+const uint32_t kArenaPageEntries = 512;
+const phys_addr_t kArenaBase = 0x100000000;
+
+// aligned for 16K granule tables as well
+alignas(16384) ttentry_t gArena[kArenaPages][kArenaPageEntries];
+uint32_t gArenaNextPage = 0;
+std::vector<virt_addr_t> gArenaFreePages;
+uint32_t gArenaWrites = 0;
+uint32_t gArenaAllocations = 0;
+uint32_t gArenaCopiedBytes = 0;
+
+class ArenaPrimitives : public Primitives
+{
+public:
+	uintptr_t	readAddress(virt_addr_t address)
+	{
+		return *(ttentry_t*)address;
+	}
+	
+	bool		readBlock(virt_addr_t address, void* dst, size_t size)
+	{
+		memcpy(dst, (const void*)address, size);
+		return true;
+	}
+	
+	void		writeAddress(virt_addr_t address, virt_addr_t data)
+	{
+		gArenaWrites++;
+		*(ttentry_t*)address = data;
+	}
+	
+	bool		writeBlock(virt_addr_t address, const void* src, size_t size)
+	{
+		gArenaWrites++;
+		memcpy((void*)address, src, size);
+		return true;
+	}
+	
+	void		copyInKernel(virt_addr_t dst, virt_addr_t src, uint32_t size)
+	{
+		gArenaCopiedBytes += size;
+		memcpy((void*)dst, (const void*)src, size);
+	}
+	
+	virt_addr_t allocInPhysicalMemory(uint32_t size)
+	{
+		gArenaAllocations++;
+		
+		// free pages are reused for single page allocations only
+		uint32_t pages = (size + sizeof(gArena[0]) - 1) / sizeof(gArena[0]);
+		if (pages == 1 && gArenaFreePages.empty() == false)
+		{
+			virt_addr_t page = gArenaFreePages.back();
+			gArenaFreePages.pop_back();
+			return page;
+		}
+		
+		assert(gArenaNextPage + pages <= kArenaPages);
+		virt_addr_t address = virt_addr_t(gArena[gArenaNextPage]);
+		gArenaNextPage += pages;
+		
+		return address;
+	}
+	
+	bool deallocInPhysicalMemory(virt_addr_t address, uint32_t size)
+	{
+		for (uint32_t offset = 0; offset < size; offset += sizeof(gArena[0]))
+			gArenaFreePages.push_back(address + offset);
+		return true;
+	}
+	
+	virt_addr_t physicalToVirtual (phys_addr_t address)
+	{
+		return virt_addr_t(gArena) + (address - kArenaBase);
+	}
+	
+	phys_addr_t virtualToPhysical (virt_addr_t address)
+	{
+		return kArenaBase + (address - virt_addr_t(gArena));
+	}
+};
+
 // MARK: - main
 
 int main(int argc, const char * argv[])
@@ -206,6 +317,9 @@ int main(int argc, const char * argv[])
 	uintptr_t value;
 	virt_addr_t vaddr;
 	phys_addr_t paddr;
+	bool relocateResult;
+	bool restoreResult;
+	virt_addr_t newPageVA;
 	
 	TCR_EL1 tcr_el1(0x2A51C251C);
 	
@@ -292,6 +406,846 @@ int main(int argc, const char * argv[])
 	});
 	assert(reverseResult == true);
 
+	printf("\n*** TEST StaticTTWalker\n");
+	
+	{
+		// same regime as mmuConfig above, walks should match dynamic walker
+		StaticTTWalker<TTGranule::Granule4K, TTLevel::Level1, 28, MyPrimitives> staticWalker(ttbr);
+		
+		const virt_addr_t addresses[] = {
+			MakeVA(E0, E1, E2, E1, 0),
+			MakeVA(E0, E1, E3, E3, 1),
+			MakeVA(E0, E3, E0, E0, 2),
+			MakeVA(E0, E3, E1, E2, 3),
+			MakeVA(E0, E2, E0, E0, 0),	// not mapped
+		};
+		
+		for (virt_addr_t address : addresses)
+		{
+			uint32_t dynamicLevels = 0, staticLevels = 0;
+			WalkResult dynamicResult = walker.walkTo(address, [&dynamicLevels] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+				dynamicLevels |= 1 << uint32_t(position->level);
+				return WalkOperation::Continue;
+			});
+			WalkResult staticResult = staticWalker.walkTo(address, [&staticLevels] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+				staticLevels |= 1 << uint32_t(position->level);
+				return WalkOperation::Continue;
+			});
+			
+			printf("0x%.16llX -> 0x%.16llX\n", address, staticResult.getOutputAddress());
+			assert(staticResult.getType() == dynamicResult.getType() && staticResult.getLevel() == dynamicResult.getLevel());
+			assert(staticResult.getDescriptor() == dynamicResult.getDescriptor() && staticResult.getOutputAddress() == dynamicResult.getOutputAddress());
+			assert(staticLevels == dynamicLevels);
+			assert(staticWalker.findPhysicalAddress(address) == walker.findPhysicalAddress(address));
+			
+			// virtual interface and view walks use unrolled walk as well
+			TTGenericWalker* genericStaticWalker = &staticWalker;
+			assert(genericStaticWalker->findPhysicalAddress(address) == walker.findPhysicalAddress(address));
+			assert(genericStaticWalker->walkTo(address, TTGenericWalker::DefaultCallback).getOutputAddress() == dynamicResult.getOutputAddress());
+			
+			WalkResult stoppedResult = staticWalker.walkViewTo(address, [] (WalkPosition* position, TTDescriptorView* entry) -> WalkOperation {
+				return (position->level == TTLevel::Level2)? WalkOperation::Stop : WalkOperation::Continue;
+			});
+			if (dynamicLevels & (1 << uint32_t(TTLevel::Level2)))
+				assert(stoppedResult.getType() == WalkResultType::Stopped && stoppedResult.getLevel() == TTLevel::Level2);
+		}
+		
+		// caches are shared with inherited cache management
+		staticWalker.enableTranslationCache(4, 2);
+		staticWalker.enableWalkCache(4);
+		for (uint32_t pass = 0; pass < 2; pass++)
+			assert(staticWalker.findPhysicalAddress(addresses[0]) == walker.findPhysicalAddress(addresses[0]));
+		assert(staticWalker.getTranslationCacheStats().hits == 1 && staticWalker.getTranslationCacheStats().misses == 1);
+		
+		// reverse walk is inherited
+		assert(staticWalker.reverseWalkFrom(addresses[1], TTGenericWalker::DefaultCallback) == true);
+	}
+
+	printf("\n*** TEST TTDescriptorView\n");
+
+	{
+		// view decoding should match format specific entries
+		const TTGranule granules[] = { TTGranule::Granule4K, TTGranule::Granule16K, TTGranule::Granule64K };
+		const ttentry_t descriptors[] = {
+			0x0000000000000000, 0x0000000000000001, 0x0000000000000002, 0x0000000000000003,
+			0x00600000BEEF0711, 0x00600000BEEF0713, 0xFFFFFFFFFFFFFFFD, 0xFFFFFFFFFFFFFFFF
+		};
+		const phys_addr_t outputAddress = 0x0000FEDCBA987654;
+		uint32_t checked = 0;
+
+		for (TTGranule granule : granules)
+		{
+			for (uint32_t level = 0; level < uint32_t(TTLevel::Count); level++)
+			{
+				for (ttentry_t descriptor : descriptors)
+				{
+					// formats without blocks can't hold entries without type bit set
+					bool hasTypeBit = (descriptor & kTTDescriptorTableBit) != 0;
+					if (hasTypeBit == false && HasBlockDescriptors(granule, TTLevel(level)) == false)
+						continue;
+
+					TTDescriptorView view(granule, TTLevel(level), descriptor);
+					TTEntrySnapshot entry(view);
+
+					assert(view.getGranule() == granule && view.getLevel() == TTLevel(level));
+					assert(view.isValid() == entry->isValid());
+					assert(view.isTableDescriptor() == entry->isTableDescriptor());
+					assert(view.isBlockDescriptor() == entry->isBlockDescriptor());
+					assert(view.isPageDescriptor() == entry->isPageDescriptor());
+					assert(view.isReserved() == entry->isReserved());
+					assert(view.getOutputAddress() == entry->getOutputAddress());
+
+					view.setOutputAddress(outputAddress);
+					entry->setOutputAddress(outputAddress);
+					assert(view.getDescriptor() == entry->getDescriptor());
+					assert(entry->getView().getDescriptor() == view.getDescriptor());
+
+					checked++;
+				}
+			}
+		}
+		printf("Compared %u descriptors\n", checked);
+
+		// view walk goes through the same entries as walkTo
+		vaddr = MakeVA(E0, E1, E3, E3, 0);
+		uint32_t levels = 0;
+		WalkResult viewResult = walker.walkViewTo(vaddr, [&levels] (WalkPosition* position, TTDescriptorView* entry) -> WalkOperation {
+			printf(" Level%d: %c%c%c 0x%.16lX\n", position->level,
+				   (entry->isValid())? 'v' : '-',
+				   (entry->isTableDescriptor())? 't' : '-',
+				   (entry->isPageDescriptor())? 'p' : '-',
+				   entry->getOutputAddress());
+			levels++;
+			return WalkOperation::Continue;
+		});
+		walkResult = walker.walkTo(vaddr);
+		assert(levels == 3);
+		assert(viewResult.getType() == WalkResultType::Complete);
+		assert(viewResult.getOutputAddress() == walkResult.getOutputAddress());
+		assert(viewResult.getDescriptor() == walkResult.getDescriptor());
+	}
+
+	printf("\n*** TEST TTTableScanner\n");
+
+	{
+		// every kernel should classify random descriptors the same way as TTDescriptorView
+		const TTGranule granules[] = { TTGranule::Granule4K, TTGranule::Granule16K, TTGranule::Granule64K };
+		const TTScanKernel kernels[] = { TTScanKernel::Scalar, TTScanKernel::SSE2, TTScanKernel::AVX2, TTScanKernel::NEON };
+		const uint32_t counts[] = { kTTScanMaxEntries, 1000, 3 };
+
+		std::vector<ttentry_t> entries(kTTScanMaxEntries);
+		std::vector<phys_addr_t> outputAddresses(kTTScanMaxEntries);
+		srand(0x5CA9);
+		for (ttentry_t& descriptor : entries)
+			descriptor = (ttentry_t(rand()) << 48) ^ (ttentry_t(rand()) << 24) ^ ttentry_t(rand());
+
+		TTTableScan* scan = new TTTableScan;
+
+		for (TTScanKernel kernel : kernels)
+		{
+			if (TTTableScanner::isKernelSupported(kernel) == false)
+				continue;
+
+			for (TTGranule granule : granules)
+			{
+				for (uint32_t level = 0; level < uint32_t(TTLevel::Count); level++)
+				{
+					for (uint32_t count : counts)
+					{
+						TTTableScanner::scan(granule, TTLevel(level), entries.data(), count, scan, outputAddresses.data(), kernel);
+
+						for (uint32_t i = 0; i < count; i++)
+						{
+							TTDescriptorView view(granule, TTLevel(level), entries[i]);
+							bool isValid = view.isValid();
+							bool isMapping = isValid && (view.isBlockDescriptor() || view.isPageDescriptor());
+
+							assert(scan->isSet(scan->valid, i) == isValid);
+							assert(scan->isSet(scan->table, i) == (isValid && view.isTableDescriptor() && level != 3));
+							assert(scan->isSet(scan->block, i) == (isValid && view.isBlockDescriptor()));
+							assert(scan->isSet(scan->page, i) == (isValid && view.isPageDescriptor()));
+							assert(scan->isSet(scan->af, i) == (isMapping && ((entries[i] >> 10) & 1) != 0));
+							assert(scan->isSet(scan->pxn, i) == (isMapping && ((entries[i] >> 53) & 1) != 0));
+							assert(scan->isSet(scan->xn, i) == (isMapping && ((entries[i] >> 54) & 1) != 0));
+							assert(outputAddresses[i] == ((isValid)? view.getOutputAddress() : kInvalidAddress));
+						}
+					}
+				}
+			}
+
+			// in place decoding
+			std::vector<ttentry_t> decoded(entries);
+			TTTableScanner::scan(TTGranule::Granule4K, TTLevel::Level2, decoded.data(), kTTScanMaxEntries, scan, decoded.data(), kernel);
+			TTTableScanner::scan(TTGranule::Granule4K, TTLevel::Level2, entries.data(), kTTScanMaxEntries, scan, outputAddresses.data(), kernel);
+			assert(decoded == outputAddresses);
+
+			printf("Kernel %d: %u valid, %u table, %u block entries (4K L2)\n", int(kernel),
+				   scan->countOf(scan->valid), scan->countOf(scan->table), scan->countOf(scan->block));
+		}
+
+		delete scan;
+	}
+
+	printf("\n*** TEST enableTranslationCache()\n");
+
+	TTWalker<MyPrimitives> cachedWalker(mmuConfig, ttbr);
+	cachedWalker.enableTranslationCache(4, 2);
+
+	vaddr = MakeVA(E0, E1, E3, E3, 1);
+	paddr = cachedWalker.findPhysicalAddress(vaddr);
+	assert(paddr == walker.findPhysicalAddress(vaddr));
+	paddr = cachedWalker.findPhysicalAddress(MakeVA(E0, E1, E3, E3, 2));
+	assert(paddr == walker.findPhysicalAddress(MakeVA(E0, E1, E3, E3, 2)));
+
+	TTCacheStats cacheStats = cachedWalker.getTranslationCacheStats();
+	printf("  hits: %llu misses: %llu\n", cacheStats.hits, cacheStats.misses);
+	assert(cacheStats.hits == 1 && cacheStats.misses == 1);
+
+	cachedWalker.invalidateTranslationRange(MakeVA(E0, E1, E3, E0, 0), MakeVA(E0, E1, E3, E3, 3));
+	paddr = cachedWalker.findPhysicalAddress(vaddr);
+	cacheStats = cachedWalker.getTranslationCacheStats();
+	printf("  hits: %llu misses: %llu (invalidated)\n", cacheStats.hits, cacheStats.misses);
+	assert(cacheStats.hits == 1 && cacheStats.misses == 2);
+
+	printf("\n*** TEST enableWalkCache()\n");
+
+	cachedWalker.enableWalkCache(4);
+
+	WalkPosition walkPath[2][uint32_t(TTLevel::Count)];
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		// second walk takes L1 and L2 descriptors from the cache
+		vaddr = MakeVA(E0, E1, E3, E3, i);
+		uint32_t levels = 0;
+		walkResult = cachedWalker.walkTo(vaddr, [&walkPath, &levels, i] (WalkPosition* position, TTGenericEntry* entry) -> WalkOperation {
+			walkPath[i][levels++] = *position;
+			return WalkOperation::Continue;
+		});
+		assert(walkResult.getType() == WalkResultType::Complete && levels == 3);
+	}
+	for (uint32_t level = 0; level < 3; level++)
+	{
+		printf(" Level%d: [%.2lu][%.2lu]\n", walkPath[1][level].level,
+			   GetLevelIndex(walkPath[1][level].tableAddress), GetEntryIndex(walkPath[1][level].entryOffset));
+		assert(walkPath[0][level].tableAddress == walkPath[1][level].tableAddress);
+		assert(walkPath[0][level].entryOffset == walkPath[1][level].entryOffset);
+	}
+
+	cacheStats = cachedWalker.getWalkCacheStats();
+	printf("  hits: %llu misses: %llu\n", cacheStats.hits, cacheStats.misses);
+	assert(cacheStats.hits == 2 && cacheStats.misses == 2);
+
+	printf("\n*** TEST translateBatch()\n");
+
+	virt_addr_t batchVA[] = {
+		MakeVA(E0, E3, E1, E2, 3),
+		MakeVA(E0, E1, E2, E1, 0),
+		MakeVA(E0, E1, E3, E3, 1),
+		MakeVA(E0, E2, E0, E0, 0),	// not mapped
+		MakeVA(E0, E1, E2, E1, 2),
+		MakeVA(E0, E3, E0, E0, 2),
+	};
+	const size_t batchCount = sizeof(batchVA) / sizeof(batchVA[0]);
+	phys_addr_t batchPA[batchCount];
+
+	walker.translateBatch(batchVA, batchPA, batchCount);
+	for (size_t i = 0; i < batchCount; i++)
+	{
+		printf("[%zu] 0x%.16llX -> 0x%.16llX\n", i, batchVA[i], batchPA[i]);
+		assert(batchPA[i] == walker.findPhysicalAddress(batchVA[i]));
+	}
+	assert(batchPA[3] == kInvalidAddress);
+
+	printf("\n*** TEST enumerateMappings()\n");
+
+	std::vector<TranslationMapping> mappings;
+	gBlockReads = 0;
+	walker.enumerateMappings(MakeVA(E0, E1, E2, E0, 0), MakeVA(E0, E1, E2, E3, 0),
+	[&mappings] (const TranslationMapping& mapping) -> WalkOperation {
+		printf("0x%.16llX -> 0x%.16llX (L%d)\n", mapping.virtualAddress, mapping.outputAddress, mapping.level);
+		mappings.push_back(mapping);
+		return WalkOperation::Continue;
+	});
+	assert(mappings.size() == 1);
+	assert(mappings[0].virtualAddress == MakeVA(E0, E1, E2, E1, 0));
+	assert(mappings[0].outputAddress == walker.findPhysicalAddress(MakeVA(E0, E1, E2, E1, 0)));
+	assert(mappings[0].level == TTLevel::Level3);
+	assert(gBlockReads == 3); // one block per level (L1 - L3)
+
+	printf("\n*** TEST enumerateMappingsParallel()\n");
+
+	// emulated tables hold only 4 entries, but walking full tables is deterministic so results can be compared
+	std::vector<TranslationMapping> sequentialMappings;
+	std::vector<TranslationMapping> parallelMappings;
+	walker.enumerateMappings(MakeVA(E0, E1, E0, E0, 0), MakeVA(E0, E1, E3, E3, 0),
+	[&sequentialMappings] (const TranslationMapping& mapping) -> WalkOperation {
+		sequentialMappings.push_back(mapping);
+		return WalkOperation::Continue;
+	});
+	walker.enumerateMappingsParallel(MakeVA(E0, E1, E0, E0, 0), MakeVA(E0, E1, E3, E3, 0),
+	[&parallelMappings] (const TranslationMapping& mapping) -> WalkOperation {
+		parallelMappings.push_back(mapping);
+		return WalkOperation::Continue;
+	}, 4);
+	printf("sequential: %zu parallel: %zu\n", sequentialMappings.size(), parallelMappings.size());
+	assert(sequentialMappings.size() == parallelMappings.size());
+	for (size_t i = 0; i < sequentialMappings.size(); i++)
+	{
+		assert(sequentialMappings[i].virtualAddress == parallelMappings[i].virtualAddress);
+		assert(sequentialMappings[i].outputAddress == parallelMappings[i].outputAddress);
+	}
+
+	printf("\n*** TEST translateRange()\n");
+
+	// unmapped L1, L2 and L3 entries are merged into single gap followed by PAGE 1
+	virt_addr_t rangeBegin = MakeVA(E0, E0, E3, E0, 0);
+	virt_addr_t rangeEnd = MakeVA(E0, E1, E2, E2, 0);
+	std::vector<TranslationExtent> extents = walker.translateRange(rangeBegin, rangeEnd);
+	for (auto& extent : extents)
+	{
+		printf("0x%.16llX - 0x%.16llX -> 0x%.16llX\n",
+			   extent.virtualAddress, extent.virtualAddress + extent.size, extent.outputAddress);
+	}
+	assert(extents.size() == 2);
+	assert(extents[0].isValid() == false);
+	assert(extents[0].virtualAddress == rangeBegin);
+	assert(extents[0].size == MakeVA(E0, E1, E2, E1, 0) - rangeBegin);
+	assert(extents[1].outputAddress == walker.findPhysicalAddress(MakeVA(E0, E1, E2, E1, 0)));
+	assert(extents[1].virtualAddress + extents[1].size == rangeEnd);
+
+	printf("\n*** TEST MappedDumpPrimitives\n");
+
+	// physical memory dump with L1, L2, L3 tables and a page mapping 0x40201000
+	const phys_addr_t kDumpBase = 0x80000000;
+	static ttentry_t dumpMemory[4][512] = {};
+	dumpMemory[0][1] = (kDumpBase + 0x1000) | 0x3;
+	dumpMemory[1][1] = (kDumpBase + 0x2000) | 0x3;
+	dumpMemory[2][1] = (kDumpBase + 0x3000) | 0x403;
+	dumpMemory[3][2] = 0x1122334455667788;
+
+	MappedDumpPrimitives dump;
+	bool dumpAdded = dump.addMemory(dumpMemory, sizeof(dumpMemory), kDumpBase);
+	assert(dumpAdded);
+	dumpAdded = dump.addMemory(dumpMemory, sizeof(dumpMemory), kDumpBase + 0x1000);
+	assert(dumpAdded == false); // overlapping regions
+	assert(dump.physicalToVirtual(kDumpBase + sizeof(dumpMemory)) == kInvalidAddress);
+
+	TTWalker<MappedDumpPrimitives> dumpWalker(mmuConfig, dump.physicalToVirtual(kDumpBase), dump);
+	paddr = dumpWalker.findPhysicalAddress(0x40201010);
+	value = dumpWalker.readAddress(dumpWalker.physicalToVirtual(paddr));
+	printf("DUMP: 0x%.16llX -> 0x%.16llX : 0x%.16lX\n", 0x40201010ULL, paddr, value);
+	assert(paddr == kDumpBase + 0x3010);
+	assert(value == 0x1122334455667788);
+	assert(dumpWalker.virtualToPhysical(dumpWalker.physicalToVirtual(paddr)) == paddr);
+
+	size_t dumpMappings = 0;
+	dumpWalker.enumerateMappingsParallel([&dumpMappings] (const TranslationMapping& mapping) -> WalkOperation {
+		dumpMappings++;
+		return WalkOperation::Continue;
+	});
+	assert(dumpMappings == 1);
+
+	printf("\n*** TEST AddressMap\n");
+
+	// page aligned keys, every other one is removed to exercise probe sequence shifting
+	const uint64_t kMapEntries = 1000;
+	AddressMap<uint64_t> addressMap;
+	for (uint64_t i = 0; i < kMapEntries; i++)
+		addressMap.insert(i << kAddressBitOffset) = i;
+	for (uint64_t i = 1; i < kMapEntries; i += 2)
+		assert(addressMap.erase(i << kAddressBitOffset));
+	assert(addressMap.erase(1 << kAddressBitOffset) == false);
+	assert(addressMap.size() == kMapEntries / 2);
+	for (uint64_t i = 0; i < kMapEntries; i++)
+	{
+		uint64_t* mapValue = addressMap.find(i << kAddressBitOffset);
+		assert((mapValue != nullptr) == (i % 2 == 0));
+		assert(mapValue == nullptr || *mapValue == i);
+	}
+
+	bool mapInserted = true;
+	addressMap.insert(0, &mapInserted);
+	assert(mapInserted == false);
+	printf("AddressMap: %zu entries\n", addressMap.size());
+
+	printf("\n*** TEST relocateRange()\n");
+	
+	// LEVEL 1 -> LEVEL 2 -> LEVEL 3.0 (last 10 pages) and LEVEL 3.1 (first 2 pages), first word of the page is its number
+	ArenaPrimitives arena;
+	virt_addr_t arenaL1 = arena.allocInPhysicalMemory(0x1000);
+	virt_addr_t arenaL2 = arena.allocInPhysicalMemory(0x1000);
+	virt_addr_t arenaL3[2] = { arena.allocInPhysicalMemory(0x1000), arena.allocInPhysicalMemory(0x1000) };
+	arena.writeAddress(arenaL1, arena.virtualToPhysical(arenaL2) | 0x3);
+	for (uint32_t e2 = 0; e2 < 2; e2++)
+	{
+		arena.writeAddress(arenaL2 + e2 * kPlatformAddressSize, arena.virtualToPhysical(arenaL3[e2]) | 0x3);
+		for (uint32_t e3 = (e2 == 0? kArenaPageEntries - 10 : 0); e3 < (e2 == 0? kArenaPageEntries : 2); e3++)
+		{
+			virt_addr_t arenaPage = arena.allocInPhysicalMemory(0x1000);
+			arena.writeAddress(arenaPage, e2 * kArenaPageEntries + e3);
+			arena.writeAddress(arenaL3[e2] + e3 * kPlatformAddressSize, arena.virtualToPhysical(arenaPage) | 0x403);
+		}
+	}
+	
+	TTWalker<ArenaPrimitives> arenaWalker(mmuConfig, arenaL1);
+	PageRelocator<ArenaPrimitives> arenaRelocator(mmuConfig, arenaL1);
+	
+	// last 8 pages of LEVEL 3.0 and 2 pages of LEVEL 3.1
+	const uint64_t kRangePages = 10;
+	virt_addr_t rangeFirst = MakeVA(E0, E0, E0, kArenaPageEntries - 8, 0);
+	virt_addr_t rangeLast = MakeVA(E0, E0, E1, E1, 0);
+	phys_addr_t rangePA[kRangePages];
+	for (uint64_t i = 0; i < kRangePages; i++)
+		rangePA[i] = arenaWalker.findPhysicalAddress(rangeFirst + i * 0x1000);
+	
+	// page after the end of LEVEL 3.1 is unmapped
+	assert(arenaRelocator.relocateRange(rangeFirst, rangeLast + 0x2000) == false);
+	
+	uint32_t rangeCallbacks = 0;
+	gArenaWrites = 0;
+	relocateResult = arenaRelocator.relocateRange(rangeFirst, rangeLast + 1, [&rangeCallbacks] (TTLevel level, TTGenericEntry* oldEntry, TTGenericEntry* newEntry) -> ttentry_t {
+		rangeCallbacks++;
+		return newEntry->getDescriptor();
+	});
+	printf("RANGE: 0x%.16llX - 0x%.16llX : %u callbacks, %u writes\n", rangeFirst, rangeLast, rangeCallbacks, gArenaWrites);
+	assert(relocateResult == true);
+	
+	// LEVEL 2 and both LEVEL 3 tables are cloned once, L1 and L2 entries are written one by one, L3 entries per table
+	assert(rangeCallbacks == 3 + kRangePages);
+	assert(gArenaWrites == 1 + 2 + 2);
+	
+	for (uint64_t i = 0; i < kRangePages; i++)
+	{
+		virt_addr_t pageVA = rangeFirst + i * 0x1000;
+		paddr = arenaWalker.findPhysicalAddress(pageVA);
+		assert(paddr != rangePA[i] && arenaRelocator.isPageRelocatedFor(pageVA));
+		assert(arenaWalker.readAddress(arenaWalker.physicalToVirtual(paddr)) == arenaWalker.readAddress(arenaWalker.physicalToVirtual(rangePA[i])));
+	}
+	assert(arenaRelocator.relocateRange(rangeFirst, rangeFirst + 1) == false);
+	
+	for (uint64_t i = 0; i < kRangePages; i++)
+	{
+		restoreResult = arenaRelocator.restorePageFor(rangeFirst + i * 0x1000);
+		assert(restoreResult == true);
+	}
+	for (uint64_t i = 0; i < kRangePages; i++)
+		assert(arenaWalker.findPhysicalAddress(rangeFirst + i * 0x1000) == rangePA[i]);
+	assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	
+	printf("\n*** TEST completeRelocations()\n");
+	
+	// pages of both LEVEL 3 tables are pending at once, one of them is cancelled
+	virt_addr_t pendingPages[3] = { rangeFirst, rangeFirst + 0x1000, rangeLast };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		newPageVA = arenaRelocator.preparePageRelocationFor(pendingPages[i]);
+		assert(newPageVA != kInvalidAddress);
+		arena.writeAddress(newPageVA, 0xDEADBEEF00000000 | i);
+	}
+	assert(arenaRelocator.getPendingRelocationCount() == 3);
+	
+	// leaf entries are not updated until completion
+	for (uint32_t i = 0; i < 3; i++)
+		assert(arenaWalker.findPhysicalAddress(pendingPages[i]) == rangePA[pendingPages[i] == rangeLast? kRangePages - 1 : i]);
+	
+	relocateResult = arenaRelocator.cancelRelocationFor(pendingPages[1]);
+	assert(relocateResult == true && arenaRelocator.isRelocationPendingFor(pendingPages[1]) == false);
+	
+	relocateResult = arenaRelocator.completeRelocations();
+	assert(relocateResult == true && arenaRelocator.getPendingRelocationCount() == 0);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		value = arena.readAddress(arena.physicalToVirtual(arenaWalker.findPhysicalAddress(pendingPages[i])));
+		printf("PENDING: 0x%.16llX : 0x%.16lX\n", pendingPages[i], value);
+		assert(arenaRelocator.isPageRelocatedFor(pendingPages[i]) == (i != 1));
+		assert(i == 1 || value == (0xDEADBEEF00000000 | i));
+	}
+	
+	restoreResult = arenaRelocator.restorePageFor(pendingPages[0]) && arenaRelocator.restorePageFor(pendingPages[2]);
+	assert(restoreResult == true);
+	assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	
+	printf("\n*** TEST RelocationTransaction\n");
+	
+	{
+		// LEVEL 2 entry 2 is invalid, so the whole transaction is rolled back
+		RelocationTransaction<ArenaPrimitives> transaction(arenaRelocator);
+		assert(transaction.prepare(rangeFirst) != kInvalidAddress);
+		assert(transaction.prepare(rangeLast) != kInvalidAddress);
+		assert(transaction.prepare(MakeVA(E0, E0, E2, E0, 0)) == kInvalidAddress);
+		assert(transaction.isRolledBack() && transaction.commit() == false);
+		assert(arenaRelocator.getPendingRelocationCount() == 0);
+		assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	}
+	
+	{
+		// 16K LEVEL 1 table is cloned before its entry without type bit stops the walk, undo log releases it once
+		MMUConfig config16K = {
+			.granule = TTGranule::Granule16K,
+			.initialLevel = TTLevel::Level0,
+			.regionSizeOffset = 16
+		};
+		
+		// 16K tables are 16K aligned
+		gArenaNextPage = (gArenaNextPage + 3) & ~3;
+		virt_addr_t l0Table16K = arena.allocInPhysicalMemory(0x4000);
+		virt_addr_t l1Table16K = arena.allocInPhysicalMemory(0x4000);
+		arena.writeAddress(l0Table16K, arena.virtualToPhysical(l1Table16K) | 0x3);
+		arena.writeAddress(l1Table16K, kArenaBase | 0x401);
+		
+		PageRelocator<ArenaPrimitives> relocator16K(config16K, l0Table16K);
+		RelocationTransaction<ArenaPrimitives> transaction(relocator16K);
+		gArenaAllocations = 0;
+		assert(transaction.prepare(0x1000) == kInvalidAddress);
+		assert(transaction.isRolledBack() && gArenaAllocations == 1);
+		assert(arena.readAddress(l0Table16K) == (arena.virtualToPhysical(l1Table16K) | 0x3));
+		
+		arena.deallocInPhysicalMemory(l0Table16K, 0x4000);
+		arena.deallocInPhysicalMemory(l1Table16K, 0x4000);
+	}
+	
+	{
+		RelocationTransaction<ArenaPrimitives> transaction(arenaRelocator);
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			newPageVA = transaction.prepare(pendingPages[i]);
+			assert(newPageVA != kInvalidAddress);
+			arena.writeAddress(newPageVA, 0xFEEDFACE00000000 | i);
+		}
+		
+		// two adjacent entries of LEVEL 3.0 are written with single block
+		gArenaWrites = 0;
+		relocateResult = transaction.commit();
+		printf("COMMIT: %zu pages, %u writes\n", transaction.getPageCount(), gArenaWrites);
+		assert(relocateResult == true && gArenaWrites == 2);
+	}
+	
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		assert(arenaRelocator.isPageRelocatedFor(pendingPages[i]));
+		assert(arena.readAddress(arena.physicalToVirtual(arenaWalker.findPhysicalAddress(pendingPages[i]))) == (0xFEEDFACE00000000 | i));
+		restoreResult = arenaRelocator.restorePageFor(pendingPages[i]);
+		assert(restoreResult == true);
+	}
+	assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	
+	printf("\n*** TEST enablePagePool()\n");
+	
+	// 13 pages for the range (3 tables and 10 pages) are carved from chunks of 4 pages
+	arenaRelocator.enablePagePool(4, 1, 8);
+	gArenaAllocations = 0;
+	relocateResult = arenaRelocator.relocateRange(rangeFirst, rangeLast + 1);
+	assert(relocateResult == true && gArenaAllocations == 4);
+	
+	for (uint64_t i = 0; i < kRangePages; i++)
+		arenaRelocator.restorePageFor(rangeFirst + i * 0x1000);
+	
+	// pages are recycled locally
+	gArenaAllocations = 0;
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		relocateResult = arenaRelocator.relocatePageFor(rangeFirst) && arenaRelocator.restorePageFor(rangeFirst);
+		assert(relocateResult == true);
+	}
+	
+	PagePoolStats poolStats = arenaRelocator.getPagePoolStats();
+	printf("POOL: %llu allocations, %llu chunks allocated, %llu released, %llu free pages\n",
+		   poolStats.allocations, poolStats.primitiveAllocations, poolStats.primitiveDeallocations, poolStats.freePages);
+	assert(gArenaAllocations == 0);
+	
+	// free pages over high watermark are released in whole chunks
+	assert(poolStats.primitiveDeallocations == 2 && poolStats.freePages == 8 && poolStats.chunks == 2);
+	
+	arenaRelocator.disablePagePool();
+	assert(arenaRelocator.getPagePoolStats().chunks == 0);
+	assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	
+	printf("\n*** TEST block splitting\n");
+	
+	// LEVEL 2 entry 3 is 2MB block and LEVEL 1 entry 1 is 1GB block with contiguous hint, both map the arena
+	// from its first page, so relocated granule has content
+	const ttentry_t kBlockAttributes = 0x0070000000000401;
+	const ttentry_t kSplitAttributes = kBlockAttributes & ~kTTDescriptorContiguousBit;
+	arena.writeAddress(arenaL2 + E3 * kPlatformAddressSize, kArenaBase | kBlockAttributes);
+	arena.writeAddress(arenaL1 + E1 * kPlatformAddressSize, kArenaBase | kBlockAttributes);
+	
+	const uint32_t kBlockPageIndex[2] = { 5, 3 };
+	virt_addr_t blockPages[2] = { MakeVA(E0, E0, E3, kBlockPageIndex[0], 0), MakeVA(E0, E1, E0, kBlockPageIndex[1], 0) };
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		virt_addr_t blockEntry = (i == 0)? arenaL2 + E3 * kPlatformAddressSize : arenaL1 + E1 * kPlatformAddressSize;
+		paddr = arenaWalker.findPhysicalAddress(blockPages[i]);
+		assert(paddr == kArenaBase + kBlockPageIndex[i] * 0x1000);
+		
+		// every block on the path is split and replaced with table, then the page is cloned
+		uint32_t splitBlocks = 0;
+		gArenaWrites = 0;
+		newPageVA = arenaRelocator.preparePageRelocationFor(blockPages[i], [&splitBlocks] (TTLevel level, TTGenericEntry* oldEntry, TTGenericEntry* newEntry) -> ttentry_t {
+			assert(level == TTLevel::Level3 || newEntry->isTableDescriptor());
+			splitBlocks += oldEntry->isBlockDescriptor();
+			return newEntry->getDescriptor();
+		});
+		assert(newPageVA != kInvalidAddress);
+		assert(arena.readAddress(newPageVA) == arena.readAddress(arena.physicalToVirtual(paddr)));
+		relocateResult = arenaRelocator.completeRelocation();
+		printf("SPLIT: 0x%.16llX -> 0x%.16llX : %u blocks split, %u writes\n", blockPages[i], arenaWalker.findPhysicalAddress(blockPages[i]), splitBlocks, gArenaWrites);
+		assert(relocateResult == true);
+		
+		// table and entry are written for each split (LEVEL 2 table is cloned for 2MB block), then leaf entry
+		assert(splitBlocks == i + 1 && gArenaWrites == ((i == 0)? 1 + 2 + 1 : 2 + 2 + 1));
+		assert(arenaWalker.findPhysicalAddress(blockPages[i]) == arena.virtualToPhysical(newPageVA));
+		
+		// other granules of the block keep output address and attributes
+		virt_addr_t splitEntry = (i == 0)? arena.physicalToVirtual(arena.readAddress(arenaL1) & 0xFFFFFFFFF000) + E3 * kPlatformAddressSize : blockEntry;
+		virt_addr_t splitTable = arena.physicalToVirtual(arena.readAddress(splitEntry) & 0xFFFFFFFFF000);
+		assert(arena.readAddress(splitTable + kPlatformAddressSize) == ((kArenaBase + ((i == 0)? 0x1000 : 0x200000)) | kSplitAttributes | ((i == 0)? 0x2 : 0x0)));
+		assert(arenaWalker.findPhysicalAddress(blockPages[i] + 0x1000) == paddr + 0x1000);
+		
+		restoreResult = arenaRelocator.restorePageFor(blockPages[i]);
+		assert(restoreResult == true);
+		assert(arena.readAddress(blockEntry) == (kArenaBase | kBlockAttributes));
+		assert(arenaWalker.findPhysicalAddress(blockPages[i]) == paddr);
+	}
+	
+	// split table is shared by pages of the block and block is restored after the last of them
+	relocateResult = arenaRelocator.relocatePageFor(blockPages[1]) && arenaRelocator.relocatePageFor(blockPages[1] + 0x1000);
+	assert(relocateResult == true);
+	restoreResult = arenaRelocator.restorePageFor(blockPages[1]);
+	assert(restoreResult == true && arena.readAddress(arenaL1 + E1 * kPlatformAddressSize) != (kArenaBase | kBlockAttributes));
+	restoreResult = arenaRelocator.restorePageFor(blockPages[1] + 0x1000);
+	assert(restoreResult == true && arena.readAddress(arenaL1 + E1 * kPlatformAddressSize) == (kArenaBase | kBlockAttributes));
+	
+	arena.writeAddress(arenaL2 + E3 * kPlatformAddressSize, 0);
+	arena.writeAddress(arenaL1 + E1 * kPlatformAddressSize, 0);
+	
+	// 16K granule has no L1 blocks, so relocation under such entry fails without changes
+	{
+		MMUConfig config16K = {
+			.granule = TTGranule::Granule16K,
+			.initialLevel = TTLevel::Level1,
+			.regionSizeOffset = 25
+		};
+		
+		virt_addr_t l1Table16K = arena.allocInPhysicalMemory(0x1000);
+		arena.writeAddress(l1Table16K, kArenaBase | kBlockAttributes);
+		
+		PageRelocator<ArenaPrimitives> relocator16K(config16K, l1Table16K);
+		gArenaAllocations = 0;
+		gArenaWrites = 0;
+		newPageVA = relocator16K.preparePageRelocationFor(0x4000);
+		assert(newPageVA == kInvalidAddress);
+		assert(gArenaAllocations == 0 && gArenaWrites == 0);
+		assert(arena.readAddress(l1Table16K) == (kArenaBase | kBlockAttributes));
+		
+		// enumeration decodes entry without type bit as L1 block, the same as findPhysicalAddress
+		TTWalker<ArenaPrimitives> walker16K(config16K, l1Table16K);
+		mappings.clear();
+		walker16K.enumerateMappings(0, 0x4000, [&mappings] (const TranslationMapping& mapping) -> WalkOperation {
+			mappings.push_back(mapping);
+			return WalkOperation::Continue;
+		});
+		assert(mappings.size() == 1 && mappings[0].level == TTLevel::Level1);
+		assert(mappings[0].outputAddress == walker16K.findPhysicalAddress(0) && mappings[0].outputAddress == kArenaBase);
+		
+		arena.deallocInPhysicalMemory(l1Table16K, 0x1000);
+	}
+	
+	// LEVEL 3 entry without page bit (reserved encoding) is translated by findPhysicalAddress, so it's enumerated too
+	{
+		virt_addr_t reservedPage = MakeVA(E0, E0, E1, E2, 0);
+		arena.writeAddress(arenaL3[1] + E2 * kPlatformAddressSize, kArenaBase | 0x401);
+		mappings.clear();
+		arenaWalker.enumerateMappings(MakeVA(E0, E0, E1, E0, 0), MakeVA(E0, E0, E1, E3, 0), [&mappings] (const TranslationMapping& mapping) -> WalkOperation {
+			mappings.push_back(mapping);
+			return WalkOperation::Continue;
+		});
+		assert(mappings.size() == 3 && mappings[2].virtualAddress == reservedPage);
+		assert(mappings[2].outputAddress == arenaWalker.findPhysicalAddress(reservedPage) && mappings[2].outputAddress == kArenaBase);
+		arena.writeAddress(arenaL3[1] + E2 * kPlatformAddressSize, 0);
+	}
+	
+	printf("\n*** TEST setLazyPageCopy()\n");
+	
+	arenaRelocator.setLazyPageCopy(true);
+	
+	// only tables are copied when page is prepared
+	gArenaCopiedBytes = 0;
+	newPageVA = arenaRelocator.preparePageRelocationFor(rangeFirst);
+	assert(newPageVA != kInvalidAddress && gArenaCopiedBytes == 2 * 0x1000);
+	
+	PageRange contentRanges[PageRelocator<ArenaPrimitives>::kMaxUncopiedRanges];
+	assert(arenaRelocator.getOriginalContentRanges(rangeFirst, contentRanges, 1) == 1);
+	assert(contentRanges[0].offset == 0 && contentRanges[0].size == 0x1000);
+	
+	// stale content of page copy, words 1 and 2 are patched
+	memset((void*)newPageVA, 0xFF, 0x1000);
+	arenaRelocator.markPageWritten(rangeFirst + 8, 16);
+	arena.writeAddress(newPageVA + 8, 0xFEEDFACE00000001);
+	arena.writeAddress(newPageVA + 16, 0xFEEDFACE00000002);
+	assert(arenaRelocator.getOriginalContentRanges(rangeFirst, contentRanges, 2) == 2);
+	assert(contentRanges[0].offset == 0 && contentRanges[0].size == 8 && contentRanges[1].offset == 24 && contentRanges[1].size == 0x1000 - 24);
+	
+	// the rest is copied on completion
+	gArenaCopiedBytes = 0;
+	relocateResult = arenaRelocator.completeRelocation();
+	printf("LAZY: 0x%.16llX : %u bytes copied on completion\n", rangeFirst, gArenaCopiedBytes);
+	assert(relocateResult == true && gArenaCopiedBytes == 0x1000 - 16);
+	assert(arena.readAddress(newPageVA) == arena.readAddress(arena.physicalToVirtual(rangePA[0])));
+	assert(arena.readAddress(newPageVA + 8) == 0xFEEDFACE00000001 && arena.readAddress(newPageVA + 24) == 0);
+	arenaRelocator.restorePageFor(rangeFirst);
+	
+	// ranges which don't fit into staging info are copied when marked, so the result is the same
+	newPageVA = arenaRelocator.preparePageRelocationFor(rangeFirst);
+	memset((void*)newPageVA, 0xFF, 0x1000);
+	for (uint32_t i = 1; i <= 2 * PageRelocator<ArenaPrimitives>::kMaxUncopiedRanges; i++)
+	{
+		arenaRelocator.markPageWritten(rangeFirst + i * 0x100, 8);
+		arena.writeAddress(newPageVA + i * 0x100, 0xFEEDFACE00000000 | i);
+	}
+	assert(arenaRelocator.getOriginalContentRanges(rangeFirst, nullptr, 0) <= PageRelocator<ArenaPrimitives>::kMaxUncopiedRanges);
+	relocateResult = arenaRelocator.completeRelocation();
+	assert(relocateResult == true);
+	for (uint32_t i = 0; i < 0x1000 / kPlatformAddressSize; i++)
+	{
+		value = arena.readAddress(newPageVA + i * kPlatformAddressSize);
+		if (i != 0 && (i * kPlatformAddressSize) % 0x100 == 0 && i * kPlatformAddressSize <= 2 * PageRelocator<ArenaPrimitives>::kMaxUncopiedRanges * 0x100)
+			assert(value == (0xFEEDFACE00000000 | (i * kPlatformAddressSize / 0x100)));
+		else
+			assert(value == arena.readAddress(arena.physicalToVirtual(rangePA[0]) + i * kPlatformAddressSize));
+	}
+	arenaRelocator.restorePageFor(rangeFirst);
+	arenaRelocator.setLazyPageCopy(false);
+	
+	printf("\n*** TEST RelocationJournal\n");
+	
+	char journalPath[] = "/tmp/mmuit-journal-XXXXXX";
+	char snapshotPath[] = "/tmp/mmuit-snapshot-XXXXXX";
+	close(mkstemp(journalPath));
+	close(mkstemp(snapshotPath));
+	
+	{
+		RelocationJournal journal;
+		relocateResult = journal.open(journalPath);
+		assert(relocateResult == true);
+		
+		PageRelocator<ArenaPrimitives> journaledRelocator(mmuConfig, arenaL1);
+		journaledRelocator.setJournal(&journal);
+		relocateResult = journaledRelocator.relocateRange(rangeFirst, rangeFirst + 4 * 0x1000) && journaledRelocator.relocatePageFor(rangeLast);
+		assert(relocateResult == true);
+		restoreResult = journaledRelocator.restorePageFor(rangeFirst);
+		assert(restoreResult == true);
+		
+		// relocation which is never completed still references tables
+		newPageVA = journaledRelocator.preparePageRelocationFor(rangeLast - 0x1000);
+		relocateResult = journal.flush();
+		assert(newPageVA != kInvalidAddress && relocateResult == true);
+		
+		// relocator ends without restoring pages
+	}
+	
+	{
+		// state is rebuilt from records and pending relocation is cancelled
+		RelocationJournal journal;
+		relocateResult = journal.open(journalPath);
+		assert(relocateResult == true);
+		
+		PageRelocator<ArenaPrimitives> recoveredRelocator(mmuConfig, arenaL1);
+		relocateResult = recoveredRelocator.recoverFromJournal(journal);
+		assert(relocateResult == true);
+		for (uint32_t i = 0; i < 4; i++)
+			assert(recoveredRelocator.isPageRelocatedFor(rangeFirst + i * 0x1000) == (i != 0));
+		assert(recoveredRelocator.isPageRelocatedFor(rangeLast) && recoveredRelocator.getPendingRelocationCount() == 0);
+		assert(arenaWalker.findPhysicalAddress(rangeLast - 0x1000) == rangePA[kRangePages - 2]);
+		
+		// snapshot has a record per relocated table or page and per relocated page
+		RelocationJournal snapshot;
+		std::vector<JournalRecord> records;
+		relocateResult = snapshot.open(snapshotPath) && recoveredRelocator.writeJournalSnapshot(snapshot) && snapshot.load(records);
+		assert(relocateResult == true);
+		printf("JOURNAL: %zu records in snapshot\n", records.size());
+		assert(records.size() == (3 + 4) + 4);
+	}
+	
+	{
+		RelocationJournal snapshot;
+		PageRelocator<ArenaPrimitives> recoveredRelocator(mmuConfig, arenaL1);
+		relocateResult = snapshot.open(snapshotPath) && recoveredRelocator.recoverFromJournal(snapshot);
+		assert(relocateResult == true);
+		
+		for (uint32_t i = 1; i < 4; i++)
+		{
+			restoreResult = recoveredRelocator.restorePageFor(rangeFirst + i * 0x1000);
+			assert(restoreResult == true);
+		}
+		restoreResult = recoveredRelocator.restorePageFor(rangeLast);
+		assert(restoreResult == true);
+		assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	}
+	
+	{
+		// chunks of page pool are journaled, so recovered relocator returns them whole
+		RelocationJournal journal;
+		relocateResult = journal.open(journalPath) && journal.reset();
+		assert(relocateResult == true);
+		
+		{
+			PageRelocator<ArenaPrimitives> pooledRelocator(mmuConfig, arenaL1);
+			pooledRelocator.enablePagePool(4, 1, 8);
+			pooledRelocator.setJournal(&journal);
+			relocateResult = pooledRelocator.relocateRange(rangeFirst, rangeFirst + 4 * 0x1000);
+			assert(relocateResult == true && pooledRelocator.getPagePoolStats().chunks == 2);
+		}
+		relocateResult = journal.flush();
+		assert(relocateResult == true);
+		
+		PageRelocator<ArenaPrimitives> recoveredRelocator(mmuConfig, arenaL1);
+		relocateResult = recoveredRelocator.recoverFromJournal(journal);
+		assert(relocateResult == true && recoveredRelocator.getPagePoolStats().chunks == 2);
+		
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			restoreResult = recoveredRelocator.restorePageFor(rangeFirst + i * 0x1000);
+			assert(restoreResult == true);
+		}
+		
+		PagePoolStats poolStats = recoveredRelocator.getPagePoolStats();
+		printf("JOURNAL: %llu chunks released after recovery\n", poolStats.primitiveDeallocations);
+		assert(poolStats.primitiveDeallocations == 2 && poolStats.chunks == 0);
+		assert(arena.readAddress(arenaL1) == (arena.virtualToPhysical(arenaL2) | 0x3));
+	}
+	
+	{
+		// incomplete record is dropped on open, so records appended after it are loaded
+		RelocationJournal journal;
+		std::vector<JournalRecord> records;
+		relocateResult = journal.open(journalPath) && journal.load(records);
+		assert(relocateResult == true);
+		size_t recordCount = records.size();
+		journal.close();
+		
+		int fd = open(journalPath, O_WRONLY | O_APPEND);
+		assert(fd >= 0 && write(fd, &records[0], sizeof(JournalRecord) / 2) > 0);
+		close(fd);
+		
+		JournalRecord record = records[0];
+		relocateResult = journal.open(journalPath);
+		assert(relocateResult == true);
+		journal.append(record);
+		relocateResult = journal.flush() && journal.load(records);
+		assert(relocateResult == true && records.size() == recordCount + 1);
+		assert(memcmp(&records.back(), &record, sizeof(record)) == 0);
+		journal.close();
+		
+		// file shorter than header has no records
+		relocateResult = journal.open(journalPath);
+		assert(relocateResult == true);
+		relocateResult = truncate(journalPath, 4) == 0 && journal.load(records);
+		assert(relocateResult == false && records.empty());
+	}
+	
+	unlink(journalPath);
+	unlink(snapshotPath);
+	
 	printf("\n*** TEST relocatePageFor()\n");
 	
 	vaddr = MakeVA(E0, E1, E3, E3, 0);
@@ -303,7 +1257,6 @@ int main(int argc, const char * argv[])
 	assert(value == 0xBBBBBBBB11111111);
 
 	// With default callback: relocator.relocatePageFor(vaddr, PageRelocator<TTGranule::Granule4K, MyPrimitives>::DefaultCallback);
-	bool relocateResult;
 	relocateResult = relocator.relocatePageFor(vaddr, [&relocator] (TTLevel level, TTGenericEntry* oldEntry, TTGenericEntry* newEntry) -> ttentry_t {
 		printf("    MOVE: 0x%.16llX -> 0x%.16llX | [%.2lu][] -> [%.2lu][]\n",
 			   oldEntry->getOutputAddress(),
@@ -336,7 +1289,6 @@ int main(int argc, const char * argv[])
 	printf("ORIGINAL: 0x%.16llX -> 0x%.16llX : 0x%.16lX\n", vaddr, paddr, value);
 	assert(value == 0xAAAAAAAA11111111);
 	
-	virt_addr_t newPageVA;
 	newPageVA = relocator.preparePageRelocationFor(vaddr, [&relocator] (TTLevel level, TTGenericEntry* oldEntry, TTGenericEntry* newEntry) -> ttentry_t {
 		printf("    MOVE: 0x%.16llX -> 0x%.16llX | [%.2lu][] -> [%.2lu][]\n",
 			   oldEntry->getOutputAddress(),
@@ -370,7 +1322,6 @@ int main(int argc, const char * argv[])
 	vaddr = MakeVA(E0, E1, E3, E3, 0);
 
 	// restore original page
-	bool restoreResult;
 	restoreResult = relocator.restorePageFor(vaddr);
 	assert(restoreResult == true);
 	
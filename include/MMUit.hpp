@@ -11,3 +11,4 @@
 #include "VMAKit.hpp"
 
 #include "Primitives.hpp"
+#include "MappedDumpPrimitives.hpp"
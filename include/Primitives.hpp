@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 class Primitives
 {
@@ -26,6 +27,10 @@ public:
 	virtual uint32_t	read32(virt_addr_t address) { assert(0); }
 	virtual uint64_t	read64(virt_addr_t address) { assert(0); }
 	virtual uintptr_t	readAddress(virt_addr_t address) { assert(0); }
+	
+	// Optional bulk read (e.g. whole translation table), should return false if not supported
+	// so callers can fall back to readAddress
+	virtual bool		readBlock(virt_addr_t, void*, size_t) { return false; }
 
 	// Write
 	
@@ -34,6 +39,10 @@ public:
 	virtual void		write32(virt_addr_t address, uint32_t data) { assert(0); }
 	virtual void		write64(virt_addr_t address, uint64_t data) { assert(0); }
 	virtual void		writeAddress(virt_addr_t address, uintptr_t data) { assert(0); }
+	
+	// Optional bulk write (e.g. range of table entries), should return false if not supported
+	// so callers can fall back to writeAddress
+	virtual bool		writeBlock(virt_addr_t, const void*, size_t) { return false; }
 
 	// Function call
 	
@@ -54,6 +63,12 @@ public:
 	
 	virtual void copyInKernel(virt_addr_t dst, virt_addr_t src, uint32_t size) { assert(0); }
 	
+	// Concurrency
+	
+	// Primitives which can read memory and convert addresses from multiple threads at once (e.g. read-only dump)
+	// should return true to allow parallel table walks
+	virtual bool isThreadSafe() { return false; }
+	
 	// Virtual <-> Physical address conversion
 
 	phys_addr_t virtualToPhysical (virt_addr_t address) { assert(0); }
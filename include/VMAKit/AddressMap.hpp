@@ -0,0 +1,202 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include <algorithm>
+#include <vector>
+
+// Flat hash map keyed by address (VA or PA)
+// Entries are stored in one array using open addressing with linear probing, so lookup is a single hash
+// and usually one cache line. kInvalidAddress marks free slots and can't be used as a key.
+// Pointers to values stay valid until next insert or erase.
+template <typename VALUE>
+class AddressMap
+{
+public:
+
+	static const uint32_t kMinimumCapacity = 16;
+
+public:
+
+	AddressMap()
+	{}
+
+	// Preallocates space for count entries
+	AddressMap(size_t count)
+	{
+		reserve(count);
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	bool empty() const
+	{
+		return m_size == 0;
+	}
+
+	VALUE* find(virt_addr_t key)
+	{
+		if (m_size == 0 || key == kInvalidAddress)
+			return nullptr;
+
+		for (size_t index = getIndex(key); ; index = (index + 1) & m_mask)
+		{
+			Slot& slot = m_slots[index];
+			if (slot.key == key)
+				return &slot.value;
+			if (slot.key == kInvalidAddress)
+				return nullptr;
+		}
+	}
+
+	bool contains(virt_addr_t key)
+	{
+		return find(key) != nullptr;
+	}
+
+	// Returns value for key, new value is default constructed and inserted is set to true
+	VALUE& insert(virt_addr_t key, bool* inserted = nullptr)
+	{
+		assert(key != kInvalidAddress);
+
+		// keep load factor under 1/2
+		if ((m_size + 1) * 2 > m_slots.size())
+			rehash(std::max<size_t>(m_slots.size() * 2, kMinimumCapacity));
+
+		size_t index = getIndex(key);
+		for (; m_slots[index].key != kInvalidAddress; index = (index + 1) & m_mask)
+		{
+			if (m_slots[index].key == key)
+			{
+				if (inserted)
+					*inserted = false;
+				return m_slots[index].value;
+			}
+		}
+
+		m_slots[index].key = key;
+		m_slots[index].value = VALUE();
+		m_size++;
+
+		if (inserted)
+			*inserted = true;
+		return m_slots[index].value;
+	}
+
+	bool erase(virt_addr_t key)
+	{
+		if (m_size == 0 || key == kInvalidAddress)
+			return false;
+
+		size_t index = getIndex(key);
+		for (; m_slots[index].key != key; index = (index + 1) & m_mask)
+		{
+			if (m_slots[index].key == kInvalidAddress)
+				return false;
+		}
+
+		// shift following entries of the probe sequence back instead of leaving tombstones
+		size_t next = index;
+		while (true)
+		{
+			next = (next + 1) & m_mask;
+			if (m_slots[next].key == kInvalidAddress)
+				break;
+
+			// entry can move only if its home slot is not between freed and current slot
+			size_t home = getIndex(m_slots[next].key);
+			if (((next - home) & m_mask) >= ((next - index) & m_mask))
+			{
+				m_slots[index] = m_slots[next];
+				index = next;
+			}
+		}
+
+		m_slots[index].key = kInvalidAddress;
+		m_size--;
+
+		return true;
+	}
+
+	void clear()
+	{
+		for (auto& slot : m_slots)
+			slot.key = kInvalidAddress;
+		m_size = 0;
+	}
+
+	// Preallocates space for count entries, map is not reallocated until it grows beyond that
+	void reserve(size_t count)
+	{
+		size_t capacity = kMinimumCapacity;
+		while (capacity < count * 2)
+			capacity *= 2;
+
+		if (capacity > m_slots.size())
+			rehash(capacity);
+	}
+
+	// Calls callback(key, value) for every entry in unspecified order, map can't be modified from callback
+	template <typename CALLBACK>
+	void forEach(CALLBACK callback)
+	{
+		for (auto& slot : m_slots)
+		{
+			if (slot.key != kInvalidAddress)
+				callback(slot.key, slot.value);
+		}
+	}
+
+private:
+
+	struct Slot
+	{
+		virt_addr_t	key;
+		VALUE		value;
+	};
+
+	size_t getIndex(virt_addr_t key) const
+	{
+		// keys are usually page aligned, multiplicative hash moves entropy into upper bits
+		return size_t((key * 0x9E3779B97F4A7C15ull) >> m_shift);
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Slot> slots(capacity, Slot{kInvalidAddress, VALUE()});
+		slots.swap(m_slots);
+
+		m_mask = capacity - 1;
+		m_shift = kPlatformAddressBits;
+		for (size_t bits = capacity; bits > 1; bits >>= 1)
+			m_shift--;
+
+		for (auto& slot : slots)
+		{
+			if (slot.key == kInvalidAddress)
+				continue;
+
+			size_t index = getIndex(slot.key);
+			while (m_slots[index].key != kInvalidAddress)
+				index = (index + 1) & m_mask;
+			m_slots[index] = slot;
+		}
+	}
+
+private:
+
+	std::vector<Slot>	m_slots;
+	size_t				m_size = 0;
+	size_t				m_mask = 0;
+	uint32_t			m_shift = kPlatformAddressBits;
+};
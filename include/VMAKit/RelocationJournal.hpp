@@ -0,0 +1,232 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class JournalRecordType : uint32_t {
+	Table = 1,		// table or page copy was allocated and entry at entryAddress redirected to it
+	Reference,		// number of pages using relocated table changed to refCount
+	Release,		// original entry was restored and copy deallocated
+	Pending,		// relocation of targetPage was prepared
+	Cancel,			// pending relocation of targetPage was cancelled
+	Page,			// leaf entry at entryAddress was redirected, targetPage is relocated
+	Restore,		// targetPage is not relocated anymore
+	Chunk,			// page pool allocated chunk of refCount pages at allocatedPage
+	ChunkRelease	// page pool returned chunk at allocatedPage to primitives
+};
+
+// Fixed size record, relocationPA identifies relocated table or page (PA of its copy)
+struct JournalRecord
+{
+	JournalRecordType	type;
+	uint32_t			refCount;
+	phys_addr_t			relocationPA;
+	virt_addr_t			entryAddress;
+	ttentry_t			originalEntry;
+	virt_addr_t			allocatedPage;
+	virt_addr_t			targetPage;
+};
+
+// Append-only binary journal of PageRelocator state changes
+// Records are buffered in memory and written to the file with single write on flush (fsync is optional), so
+// relocator state can be rebuilt after restart by replaying records once (see PageRelocator::recoverFromJournal).
+// Incomplete record at the end of file (interrupted write) is dropped on open, so appended records stay aligned.
+class RelocationJournal
+{
+public:
+
+	static const uint32_t kMagic = 0x4A554D4D;	// 'MMUJ'
+	static const uint32_t kVersion = 1;
+
+public:
+
+	RelocationJournal()
+	{}
+
+	RelocationJournal(const RelocationJournal&) = delete;
+	RelocationJournal& operator=(const RelocationJournal&) = delete;
+
+	~RelocationJournal()
+	{
+		close();
+	}
+
+	// Opens existing journal or creates new one, records are appended to the end
+	bool open(const char* path)
+	{
+		if (path == nullptr || m_fd >= 0)
+			return false;
+
+		m_fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+		if (m_fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(m_fd, &info) != 0)
+		{
+			close();
+			return false;
+		}
+
+		if (info.st_size == 0)
+			return writeHeader();
+
+		Header header;
+		if (pread(m_fd, &header, sizeof(header), 0) != sizeof(header) || isHeaderValid(header) == false)
+		{
+			close();
+			return false;
+		}
+
+		// cut incomplete record, records are appended after the last complete one
+		off_t size = sizeof(Header) + off_t((size_t(info.st_size) - sizeof(Header)) / sizeof(JournalRecord) * sizeof(JournalRecord));
+		if (size != info.st_size && ftruncate(m_fd, size) != 0)
+		{
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// Flushes buffered records and closes file
+	void close()
+	{
+		if (m_fd < 0)
+			return;
+
+		flush();
+		::close(m_fd);
+		m_fd = -1;
+	}
+
+	bool isOpen() const
+	{
+		return m_fd >= 0;
+	}
+
+	void append(const JournalRecord& record)
+	{
+		m_buffer.push_back(record);
+	}
+
+	// Writes buffered records, with sync they are also flushed to storage
+	bool flush(bool sync = false)
+	{
+		if (m_fd < 0)
+			return false;
+
+		if (writeAll(m_buffer.data(), m_buffer.size() * sizeof(JournalRecord)) == false)
+			return false;
+
+		// buffer keeps its capacity, so appending doesn't allocate after first flushes
+		m_buffer.clear();
+
+		return (sync)? fsync(m_fd) == 0 : true;
+	}
+
+	size_t getBufferedRecordCount() const
+	{
+		return m_buffer.size();
+	}
+
+	// Reads all records written to the file (buffered ones are not included)
+	bool load(std::vector<JournalRecord>& records)
+	{
+		records.clear();
+
+		struct stat info;
+		if (m_fd < 0 || fstat(m_fd, &info) != 0)
+			return false;
+
+		// header could be missing if reset failed to write it
+		if (size_t(info.st_size) < sizeof(Header))
+			return false;
+
+		size_t count = (size_t(info.st_size) - sizeof(Header)) / sizeof(JournalRecord);
+		records.resize(count);
+
+		size_t size = count * sizeof(JournalRecord);
+		for (size_t offset = 0; offset < size; )
+		{
+			ssize_t result = pread(m_fd, (uint8_t*)records.data() + offset, size - offset, sizeof(Header) + offset);
+			if (result <= 0)
+			{
+				records.clear();
+				return false;
+			}
+			offset += size_t(result);
+		}
+
+		return true;
+	}
+
+	// Drops all records (written and buffered)
+	bool reset()
+	{
+		m_buffer.clear();
+
+		if (m_fd < 0 || ftruncate(m_fd, 0) != 0)
+			return false;
+
+		return writeHeader();
+	}
+
+private:
+
+	struct Header
+	{
+		uint32_t	magic;
+		uint32_t	version;
+		uint32_t	recordSize;
+		uint32_t	reserved;
+	};
+
+	bool isHeaderValid(const Header& header) const
+	{
+		return header.magic == kMagic && header.version == kVersion && header.recordSize == sizeof(JournalRecord);
+	}
+
+	bool writeHeader()
+	{
+		Header header = {
+			.magic = kMagic,
+			.version = kVersion,
+			.recordSize = sizeof(JournalRecord),
+			.reserved = 0
+		};
+
+		return writeAll(&header, sizeof(header));
+	}
+
+	bool writeAll(const void* data, size_t size)
+	{
+		for (size_t offset = 0; offset < size; )
+		{
+			ssize_t result = write(m_fd, (const uint8_t*)data + offset, size - offset);
+			if (result <= 0)
+				return false;
+			offset += size_t(result);
+		}
+
+		return true;
+	}
+
+private:
+
+	int	m_fd = -1;
+
+	std::vector<JournalRecord>	m_buffer;
+};
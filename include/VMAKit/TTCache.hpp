@@ -0,0 +1,364 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include "VMATypes.hpp"
+#include "VirtualAddress.hpp"
+#include <vector>
+
+struct TTCacheStats
+{
+	uint64_t	hits;
+	uint64_t	misses;
+	uint64_t	evictions;
+};
+
+// MARK: - Translation Cache
+
+// Set-associative cache of completed translations (software TLB)
+// Cache is not coherent with translation tables, use invalidate functions after modifying them
+class TTTranslationCache
+{
+public:
+
+	static const uint32_t kDefaultSets = 256;
+	static const uint32_t kDefaultWays = 4;
+
+	struct Translation
+	{
+		virt_addr_t	pageAddress;	// granule aligned VA (tag)
+		phys_addr_t	outputAddress;	// granule aligned PA
+		ttentry_t	descriptor;		// leaf descriptor
+		TTLevel		level;			// leaf level
+		TTGranule	granule;
+	};
+
+public:
+
+	TTTranslationCache()
+	{
+		resetStats();
+	}
+
+	// number of sets should be power of 2, zero sets or ways disables cache
+	void configure(TTGranule granule, uint32_t sets, uint32_t ways)
+	{
+		assert((sets & (sets - 1)) == 0);
+
+		m_granule = granule;
+		m_pageMask = uint32_t(granule) - 1;
+		m_granuleShift = GetGranuleShift(granule);
+
+		if (sets == 0 || ways == 0)
+		{
+			m_sets = 0;
+			m_ways = 0;
+			m_entries.clear();
+			m_nextVictim.clear();
+		}
+		else
+		{
+			m_sets = sets;
+			m_ways = ways;
+			m_entries.assign(sets * ways, Translation());
+			m_nextVictim.assign(sets, 0);
+			invalidateAll();
+		}
+
+		resetStats();
+	}
+
+	bool isEnabled() const
+	{
+		return m_sets != 0;
+	}
+
+	bool lookup(virt_addr_t address, Translation* translation)
+	{
+		if (isEnabled() == false)
+			return false;
+
+		virt_addr_t pageAddress = address & ~m_pageMask;
+		Translation* set = getSet(pageAddress);
+
+		for (uint32_t way = 0; way < m_ways; way++)
+		{
+			if (set[way].pageAddress == pageAddress && set[way].granule == m_granule)
+			{
+				if (translation)
+					*translation = set[way];
+				m_stats.hits++;
+				return true;
+			}
+		}
+
+		m_stats.misses++;
+		return false;
+	}
+
+	void insert(virt_addr_t address, phys_addr_t outputAddress, ttentry_t descriptor, TTLevel level)
+	{
+		if (isEnabled() == false)
+			return;
+
+		virt_addr_t pageAddress = address & ~m_pageMask;
+		uint32_t setIndex = getSetIndex(pageAddress);
+		Translation* set = &m_entries[setIndex * m_ways];
+
+		// reuse existing or free way if possible
+		uint32_t victim = m_ways;
+		for (uint32_t way = 0; way < m_ways; way++)
+		{
+			if (set[way].pageAddress == pageAddress)
+			{
+				victim = way;
+				break;
+			}
+			if (victim == m_ways && set[way].pageAddress == kInvalidAddress)
+				victim = way;
+		}
+
+		// evict in round robin order otherwise
+		if (victim == m_ways)
+		{
+			victim = m_nextVictim[setIndex];
+			m_nextVictim[setIndex] = (victim + 1) % m_ways;
+			m_stats.evictions++;
+		}
+
+		set[victim].pageAddress = pageAddress;
+		set[victim].outputAddress = outputAddress & ~m_pageMask;
+		set[victim].descriptor = descriptor;
+		set[victim].level = level;
+		set[victim].granule = m_granule;
+	}
+
+	void invalidate(virt_addr_t address)
+	{
+		if (isEnabled() == false)
+			return;
+
+		virt_addr_t pageAddress = address & ~m_pageMask;
+		Translation* set = getSet(pageAddress);
+
+		for (uint32_t way = 0; way < m_ways; way++)
+		{
+			if (set[way].pageAddress == pageAddress)
+				set[way].pageAddress = kInvalidAddress;
+		}
+	}
+
+	// invalidate translations for pages in [begin, end)
+	void invalidateRange(virt_addr_t begin, virt_addr_t end)
+	{
+		if (isEnabled() == false || begin >= end)
+			return;
+
+		virt_addr_t firstPage = begin & ~m_pageMask;
+		uint64_t pageCount = ((end - 1 - firstPage) >> m_granuleShift) + 1;
+
+		// probe page by page if range is smaller than the cache
+		if (pageCount < m_entries.size())
+		{
+			for (uint64_t page = 0; page < pageCount; page++)
+				invalidate(firstPage + (page << m_granuleShift));
+			return;
+		}
+
+		for (auto& entry : m_entries)
+		{
+			if (entry.pageAddress >= firstPage && entry.pageAddress < end)
+				entry.pageAddress = kInvalidAddress;
+		}
+	}
+
+	void invalidateAll()
+	{
+		for (auto& entry : m_entries)
+			entry.pageAddress = kInvalidAddress;
+	}
+
+	TTCacheStats getStats() const
+	{
+		return m_stats;
+	}
+
+	void resetStats()
+	{
+		m_stats.hits = 0;
+		m_stats.misses = 0;
+		m_stats.evictions = 0;
+	}
+
+private:
+
+	uint32_t getSetIndex(virt_addr_t pageAddress) const
+	{
+		return uint32_t(pageAddress >> m_granuleShift) & (m_sets - 1);
+	}
+
+	Translation* getSet(virt_addr_t pageAddress)
+	{
+		return &m_entries[getSetIndex(pageAddress) * m_ways];
+	}
+
+private:
+
+	TTGranule		m_granule = TTGranule::Undefined;
+	virt_addr_t		m_pageMask = 0;
+	uint32_t		m_granuleShift = 0;
+
+	uint32_t		m_sets = 0;
+	uint32_t		m_ways = 0;
+
+	std::vector<Translation>	m_entries;
+	std::vector<uint32_t>		m_nextVictim;
+
+	TTCacheStats	m_stats;
+};
+
+// MARK: - Walk Cache
+
+// Cache of intermediate table descriptors (page walk cache)
+// Entries are indexed by level and IA bits resolved up to that level, so cached descriptor
+// is valid for every address sharing the same path through upper level tables
+class TTWalkCache
+{
+public:
+
+	static const uint32_t kDefaultEntriesPerLevel = 64;
+
+public:
+
+	TTWalkCache()
+	{
+		resetStats();
+	}
+
+	// number of entries should be power of 2, zero entries disables cache
+	void configure(TTGranule granule, uint32_t regionSizeOffset, uint32_t entriesPerLevel)
+	{
+		assert((entriesPerLevel & (entriesPerLevel - 1)) == 0);
+		assert(regionSizeOffset < kPlatformAddressBits);
+
+		m_granule = granule;
+		m_regionMask = (virt_addr_t(1) << (kPlatformAddressBits - regionSizeOffset)) - 1;
+		m_entriesPerLevel = entriesPerLevel;
+
+		for (uint32_t level = 0; level < uint32_t(TTLevel::Count); level++)
+			m_levelShift[level] = GetLevelShift(granule, TTLevel(level));
+
+		m_entries.assign(entriesPerLevel * uint32_t(TTLevel::Count), Entry());
+		invalidateAll();
+
+		resetStats();
+	}
+
+	bool isEnabled() const
+	{
+		return m_entriesPerLevel != 0;
+	}
+
+	bool lookup(TTLevel level, virt_addr_t address, ttentry_t* descriptor)
+	{
+		if (isEnabled() == false)
+			return false;
+
+		virt_addr_t prefix = getPrefix(level, address);
+		Entry& entry = getEntry(level, prefix);
+
+		if (entry.prefix != prefix)
+		{
+			m_stats.misses++;
+			return false;
+		}
+
+		*descriptor = entry.descriptor;
+		m_stats.hits++;
+		return true;
+	}
+
+	void insert(TTLevel level, virt_addr_t address, ttentry_t descriptor)
+	{
+		if (isEnabled() == false)
+			return;
+
+		virt_addr_t prefix = getPrefix(level, address);
+		Entry& entry = getEntry(level, prefix);
+
+		if (entry.prefix != kInvalidAddress && entry.prefix != prefix)
+			m_stats.evictions++;
+
+		entry.prefix = prefix;
+		entry.descriptor = descriptor;
+	}
+
+	// invalidate descriptors on the path to address
+	void invalidate(virt_addr_t address)
+	{
+		if (isEnabled() == false)
+			return;
+
+		for (uint32_t level = 0; level < uint32_t(TTLevel::Count); level++)
+		{
+			virt_addr_t prefix = getPrefix(TTLevel(level), address);
+			Entry& entry = getEntry(TTLevel(level), prefix);
+			if (entry.prefix == prefix)
+				entry.prefix = kInvalidAddress;
+		}
+	}
+
+	void invalidateAll()
+	{
+		for (auto& entry : m_entries)
+			entry.prefix = kInvalidAddress;
+	}
+
+	TTCacheStats getStats() const
+	{
+		return m_stats;
+	}
+
+	void resetStats()
+	{
+		m_stats.hits = 0;
+		m_stats.misses = 0;
+		m_stats.evictions = 0;
+	}
+
+private:
+
+	struct Entry
+	{
+		virt_addr_t	prefix;		// IA bits resolved up to entry level (tag)
+		ttentry_t	descriptor;
+	};
+
+	virt_addr_t getPrefix(TTLevel level, virt_addr_t address) const
+	{
+		return (address & m_regionMask) >> m_levelShift[uint32_t(level)];
+	}
+
+	Entry& getEntry(TTLevel level, virt_addr_t prefix)
+	{
+		return m_entries[uint32_t(level) * m_entriesPerLevel + uint32_t(prefix & (m_entriesPerLevel - 1))];
+	}
+
+private:
+
+	TTGranule		m_granule = TTGranule::Undefined;
+	virt_addr_t		m_regionMask = 0;
+	uint32_t		m_levelShift[uint32_t(TTLevel::Count)];
+
+	uint32_t			m_entriesPerLevel = 0;
+	std::vector<Entry>	m_entries;
+
+	TTCacheStats	m_stats;
+};
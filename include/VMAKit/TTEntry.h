@@ -12,6 +12,7 @@
 #include "VMATypes.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -81,6 +82,38 @@ typedef enum {
 	kSH_OuterShareable	= 0b10,
 	kSH_InnerShareable	= 0b11,
 } TTDescriptorSH;
+
+// Decoded descriptor (see ttentry_Decode), attributes which don't apply to descriptor type are zero
+typedef struct
+{
+	ttentry_t			descriptor;
+	phys_addr_t			outputAddress;	// kInvalidAddress if descriptor is not valid
+	
+	bool				isValid;
+	bool				isTable;
+	bool				isBlock;
+	bool				isPage;
+	bool				isReserved;
+	
+	// Table attributes (valid table descriptors only)
+	bool				pxnTable;
+	bool				xnTable;
+	TTDescriptorAPTable	apTable;
+	bool				nsTable;
+	
+	// Block and Page attributes (valid block and page descriptors only)
+	uint8_t				attrIndx;
+	bool				ns;
+	TTDescriptorAP		ap;
+	TTDescriptorSH		sh;
+	bool				af;
+	bool				nG;
+	bool				contiguous;
+	bool				pxn;
+	bool				xn;
+} TTEntryDecoded;
+	
+// Entry functions only read and modify passed details and keep no state, so they can be called from multiple threads
 	
 // Generic Entry
 	
@@ -130,6 +163,12 @@ void		ttentry_SetContiguous(TTEntryDetails* entry, bool value);
 void		ttentry_SetPXN(TTEntryDetails* entry, bool value);
 void		ttentry_SetXN(TTEntryDetails* entry, bool value);
 
+// Batch decoding
+
+void		ttentry_Decode(const TTEntryDetails* entry, TTEntryDecoded* decoded);
+void		ttentry_DecodeArray(const TTEntryDetails* entries, size_t count, TTEntryDecoded* decoded);
+void		ttentry_DecodeTable(TTGranule granule, TTLevel level, const ttentry_t* descriptors, size_t count, TTEntryDecoded* decoded);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,8 @@
 
 #include "VMAPlatform.hpp"
 #include "VMATypes.hpp"
+#include <new>
+#include <type_traits>
 
 enum class APTableAttribute : uint32_t	// Access permissions limit for subsequent levels of lookup
 {
@@ -40,6 +42,20 @@ constexpr ttentry_t MakeEntryAddress(phys_addr_t address, uint64_t bitPos, uint6
 	return ((address >> bitPos) & ((ttentry_t(1) << bitLength) - 1));
 }
 
+// Block descriptors are only supported at level 1 (4K granule) and level 2
+constexpr bool HasBlockDescriptors(TTGranule granule, TTLevel level)
+{
+	return (level == TTLevel::Level2) || (level == TTLevel::Level1 && granule == TTGranule::Granule4K);
+}
+
+// Lower [11:2] and upper [63:52] attributes of block and page descriptors
+static const ttentry_t kTTDescriptorAttributesMask = 0xFFF0000000000FFC;
+static const ttentry_t kTTDescriptorContiguousBit = ttentry_t(1) << 52;
+
+// Descriptor type bits [1:0]
+static const ttentry_t kTTDescriptorValidBit = 0x1;
+static const ttentry_t kTTDescriptorTableBit = 0x2;	// page bit at level 3
+
 // D4.3 VMSAv8-64 translation table format descriptors (Figure D4-15)
 
 struct TTInvalidDescriptor
@@ -359,7 +375,7 @@ union TTDescriptorFormat<TTGranule::Granule4K, TTLevel::Level3>
 	
 	phys_addr_t getOutputAddress() const
 	{
-		return page.address << 12;
+		return ttentry_t(page.address) << 12;
 	}
 	void		setOutputAddress(phys_addr_t address)
 	{
@@ -623,7 +639,7 @@ union TTDescriptorFormat<TTGranule::Granule16K, TTLevel::Level3>
 	
 	phys_addr_t getOutputAddress() const
 	{
-		return page.address << 14;
+		return ttentry_t(page.address) << 14;
 	}
 	void		setOutputAddress(phys_addr_t address)
 	{
@@ -888,7 +904,7 @@ union TTDescriptorFormat<TTGranule::Granule64K, TTLevel::Level3>
 	
 	phys_addr_t getOutputAddress() const
 	{
-		return page.address << 16;
+		return ttentry_t(page.address) << 16;
 	}
 	void		setOutputAddress(phys_addr_t address)
 	{
@@ -896,8 +912,102 @@ union TTDescriptorFormat<TTGranule::Granule64K, TTLevel::Level3>
 	}
 };
 
+// MARK: - Table Translation Descriptor View
+
+// Output address bits [47:shift] are the same field in every descriptor format
+static const ttentry_t kTTDescriptorOutputAddressMask = (ttentry_t(1) << 48) - 1;
+
+// Decoding parameters of descriptor format, type masks select bit which makes descriptor of that type
+struct TTDescriptorLayout
+{
+	uint8_t	tableShift;		// lowest OA bit of table and page descriptors
+	uint8_t	blockShift;		// lowest OA bit of block descriptors (table shift for formats without blocks)
+	uint8_t	tableMask;		// table if set (valid bit for formats which can only be table)
+	uint8_t	blockMask;		// block if clear
+	uint8_t	pageMask;		// page if set
+	uint8_t	reservedMask;	// reserved if clear
+};
+
+// Layouts indexed by [granule][level], same semantics as TTDescriptorFormat specializations above
+static const TTDescriptorLayout kTTDescriptorLayouts[3][uint32_t(TTLevel::Count)] = {
+	{ { 12, 12, 0x1, 0x0, 0x0, 0x0 }, { 12, 30, 0x2, 0x2, 0x0, 0x0 }, { 12, 21, 0x2, 0x2, 0x0, 0x0 }, { 12, 12, 0x0, 0x0, 0x1, 0x2 } },
+	{ { 14, 14, 0x1, 0x0, 0x0, 0x0 }, { 14, 14, 0x2, 0x2, 0x0, 0x0 }, { 14, 25, 0x2, 0x2, 0x0, 0x0 }, { 14, 14, 0x0, 0x0, 0x1, 0x2 } },
+	{ { 16, 16, 0x1, 0x0, 0x0, 0x0 }, { 16, 16, 0x2, 0x2, 0x0, 0x0 }, { 16, 29, 0x2, 0x2, 0x0, 0x0 }, { 16, 16, 0x0, 0x0, 0x1, 0x2 } },
+};
+
+// Descriptor with its granule and level, decoded with layout tables instead of format specific types
+// Trivially copyable replacement of TTGenericEntry for walks and callbacks, no virtual calls or allocations
+class TTDescriptorView
+{
+public:
+
+	TTDescriptorView() = default;
+
+	TTDescriptorView(TTGranule granule, TTLevel level, ttentry_t descriptor)
+		: m_descriptor(descriptor), m_granuleIndex(getGranuleIndex(granule)), m_level(uint8_t(level))
+	{}
+
+	TTGranule	getGranule() const		{ return TTGranule(uint32_t(1) << (12 + 2 * m_granuleIndex));	}
+	TTLevel		getLevel() const		{ return TTLevel(m_level);									}
+
+	ttentry_t	getDescriptor() const				{ return m_descriptor;			}
+	void		setDescriptor(ttentry_t descriptor)	{ m_descriptor = descriptor;	}
+
+	bool isValid()				const	{ return (m_descriptor & kTTDescriptorValidBit) != 0;		}
+	bool isTableDescriptor()	const	{ return (m_descriptor & getLayout().tableMask) != 0;		}
+	bool isBlockDescriptor()	const	{ return (~m_descriptor & getLayout().blockMask) != 0;		}
+	bool isPageDescriptor()		const	{ return (m_descriptor & getLayout().pageMask) != 0;		}
+	bool isReserved()			const	{ return (~m_descriptor & getLayout().reservedMask) != 0;	}
+
+	phys_addr_t getOutputAddress() const
+	{
+		if (isValid() == false)
+			return kInvalidAddress;
+
+		return m_descriptor & getOutputAddressMask();
+	}
+	void		setOutputAddress(phys_addr_t address)
+	{
+		ttentry_t mask = getOutputAddressMask();
+		m_descriptor = (m_descriptor & ~mask) | (address & mask);
+	}
+
+	// Lower and upper attributes of block and page descriptors
+	ttentry_t	getAttributes() const	{ return m_descriptor & kTTDescriptorAttributesMask; }
+
+private:
+
+	static uint8_t getGranuleIndex(TTGranule granule)
+	{
+		return (granule == TTGranule::Granule4K)? 0 : (granule == TTGranule::Granule16K)? 1 : 2;
+	}
+
+	const TTDescriptorLayout& getLayout() const
+	{
+		return kTTDescriptorLayouts[m_granuleIndex][m_level];
+	}
+
+	ttentry_t getOutputAddressMask() const
+	{
+		const TTDescriptorLayout& layout = getLayout();
+		uint32_t shift = isBlockDescriptor()? layout.blockShift : layout.tableShift;
+		return kTTDescriptorOutputAddressMask & ~((ttentry_t(1) << shift) - 1);
+	}
+
+private:
+
+	ttentry_t	m_descriptor;
+	uint8_t		m_granuleIndex;
+	uint8_t		m_level;
+};
+
+static_assert(std::is_trivially_copyable<TTDescriptorView>::value, "descriptor view should be trivially copyable");
+
 // MARK: - Table Translation Entry
 
+// Size of storage for a copy of any entry type (see TTGenericEntry::cloneInto)
+static const uint32_t kTTEntryStorageSize = 4 * sizeof(uint64_t);
+
 class TTGenericEntry
 {
 public:
@@ -908,11 +1018,15 @@ public:
 	TTGranule			getGranule() { return m_granule; }
 	TTLevel				getLevel() { return m_level; }
 	
+	TTDescriptorView	getView() const { return TTDescriptorView(m_granule, m_level, getDescriptor()); }
+	
 public:
 	
 	virtual ~TTGenericEntry() {};
 	
 	virtual TTGenericEntry* clone() = 0;
+	// Constructs copy of entry in storage of kTTEntryStorageSize bytes (no heap allocation)
+	virtual TTGenericEntry* cloneInto(void* storage) const = 0;
 	
 	virtual bool		isValid()			const	= 0;
 	virtual bool		isBlockDescriptor()	const	= 0;
@@ -954,6 +1068,12 @@ public: // TTGenericEntry
 		return new TTEntry<GRANULE, LEVEL>(m_descriptor.value);
 	}
 	
+	TTGenericEntry* cloneInto(void* storage) const override
+	{
+		static_assert(sizeof(TTEntry<GRANULE, LEVEL>) <= kTTEntryStorageSize, "entry doesn't fit into storage");
+		return new (storage) TTEntry<GRANULE, LEVEL>(m_descriptor.value);
+	}
+	
 	bool isValid()				const override { return m_descriptor.isValid();				}
 	bool isBlockDescriptor()	const override { return m_descriptor.isBlockDescriptor();	}
 	bool isTableDescriptor()	const override { return m_descriptor.isTableDescriptor();	}
@@ -1024,6 +1144,66 @@ private:
 	DescriptorFormat	m_descriptor;
 };
 
+// Copy of the entry stored by value, can be used instead of clone() to avoid heap allocation
+class TTEntrySnapshot
+{
+public:
+	
+	TTEntrySnapshot() = delete;
+	TTEntrySnapshot(const TTEntrySnapshot&) = delete;
+	TTEntrySnapshot& operator=(const TTEntrySnapshot&) = delete;
+	
+	TTEntrySnapshot(const TTGenericEntry& entry)
+		: m_entry(entry.cloneInto(&m_storage))
+	{}
+	
+	// Entry of view format, used to pass views to TTGenericEntry based code
+	TTEntrySnapshot(const TTDescriptorView& view)
+		: m_entry(constructEntry(view.getGranule(), view.getLevel(), view.getDescriptor()))
+	{}
+	
+	~TTEntrySnapshot()
+	{
+		m_entry->~TTGenericEntry();
+	}
+	
+	TTGenericEntry* get()			{ return m_entry; }
+	TTGenericEntry* operator->()	{ return m_entry; }
+	
+private:
+	
+	template <TTGranule GRANULE>
+	TTGenericEntry* constructEntry(TTLevel level, ttentry_t descriptor)
+	{
+		switch (level)
+		{
+			case TTLevel::Level0: return new (&m_storage) TTEntry<GRANULE, TTLevel::Level0>(descriptor);
+			case TTLevel::Level1: return new (&m_storage) TTEntry<GRANULE, TTLevel::Level1>(descriptor);
+			case TTLevel::Level2: return new (&m_storage) TTEntry<GRANULE, TTLevel::Level2>(descriptor);
+			case TTLevel::Level3: return new (&m_storage) TTEntry<GRANULE, TTLevel::Level3>(descriptor);
+			default: assert(0);
+		}
+		
+		return nullptr;
+	}
+	
+	TTGenericEntry* constructEntry(TTGranule granule, TTLevel level, ttentry_t descriptor)
+	{
+		switch (granule)
+		{
+			case TTGranule::Granule4K: return constructEntry<TTGranule::Granule4K>(level, descriptor);
+			case TTGranule::Granule16K: return constructEntry<TTGranule::Granule16K>(level, descriptor);
+			case TTGranule::Granule64K: return constructEntry<TTGranule::Granule64K>(level, descriptor);
+			default: assert(0);
+		}
+		
+		return nullptr;
+	}
+	
+	std::aligned_storage<kTTEntryStorageSize>::type	m_storage;
+	TTGenericEntry*									m_entry;
+};
+
 // MARK: - Table Translation Entry types
 
 using TTLevel0Entry_4K	= TTEntry<TTGranule::Granule4K, TTLevel::Level0>;
@@ -0,0 +1,139 @@
+//
+//  Copyright (c) 2017, Alexander Hude
+//  All rights reserved.
+//
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree.
+//
+
+#pragma once
+
+#include "VMAPlatform.hpp"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool of threads processing tasks which can spawn more tasks
+// Every thread owns a queue, new tasks are taken from its back while idle threads steal from the front of other queues
+template <typename TASK>
+class TaskPool
+{
+public:
+
+	TaskPool() = delete;
+
+	// zero threadCount uses number of hardware threads
+	TaskPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0)
+			threadCount = 1;
+
+		// queues hold mutexes, so they are allocated separately and never copied or moved
+		for (uint32_t threadIndex = 0; threadIndex < threadCount; threadIndex++)
+			m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		m_pendingTasks = 0;
+	}
+
+	uint32_t getThreadCount() const
+	{
+		return uint32_t(m_queues.size());
+	}
+
+	// Queue task for threadIndex, can be called from the worker while pool is running
+	void push(uint32_t threadIndex, const TASK& task)
+	{
+		Queue& queue = *m_queues[threadIndex];
+
+		m_pendingTasks++;
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+
+	// Calls worker(threadIndex, task) for every task until all queues are empty
+	// Calling thread is used as thread 0
+	template <typename WORKER>
+	void run(WORKER& worker)
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t threadIndex = 1; threadIndex < getThreadCount(); threadIndex++)
+			threads.push_back(std::thread([this, &worker, threadIndex] () { process(threadIndex, worker); }));
+
+		process(0, worker);
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+private:
+
+	struct Queue
+	{
+		std::mutex			mutex;
+		std::deque<TASK>	tasks;
+	};
+
+	template <typename WORKER>
+	void process(uint32_t threadIndex, WORKER& worker)
+	{
+		TASK task;
+
+		// pending counter includes tasks being processed, as they can spawn new ones
+		while (m_pendingTasks != 0)
+		{
+			if (popTask(threadIndex, &task) || stealTask(threadIndex, &task))
+			{
+				worker(threadIndex, task);
+				m_pendingTasks--;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	bool popTask(uint32_t threadIndex, TASK* task)
+	{
+		Queue& queue = *m_queues[threadIndex];
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			return false;
+
+		*task = queue.tasks.back();
+		queue.tasks.pop_back();
+
+		return true;
+	}
+
+	bool stealTask(uint32_t threadIndex, TASK* task)
+	{
+		for (uint32_t i = 1; i < getThreadCount(); i++)
+		{
+			Queue& queue = *m_queues[(threadIndex + i) % getThreadCount()];
+
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+
+			// oldest tasks are closer to the root and usually represent larger subtrees
+			*task = queue.tasks.front();
+			queue.tasks.pop_front();
+
+			return true;
+		}
+
+		return false;
+	}
+
+private:
+
+	std::vector<std::unique_ptr<Queue>>	m_queues;
+	std::atomic<uint64_t>	m_pendingTasks;
+};
@@ -11,6 +11,24 @@
 #include "VMAPlatform.hpp"
 #include "VMATypes.hpp"
 
+// Number of IA bits used as output address offset for the granule (4K: 12, 16K: 14, 64K: 16)
+constexpr uint32_t GetGranuleShift(TTGranule granule)
+{
+	return (granule == TTGranule::Granule4K)? 12 : (granule == TTGranule::Granule16K)? 14 : 16;
+}
+
+// Number of IA bits resolved by one level of lookup (table holds 1 << bits entries)
+constexpr uint32_t GetLevelIndexBits(TTGranule granule)
+{
+	return GetGranuleShift(granule) - 3;
+}
+
+// Lowest IA bit resolved at the level, i.e. log2 of memory size mapped by one entry
+constexpr uint32_t GetLevelShift(TTGranule granule, TTLevel level)
+{
+	return GetGranuleShift(granule) + (uint32_t(TTLevel::Level3) - uint32_t(level)) * GetLevelIndexBits(granule);
+}
+
 template <TTGranule GRANULE> struct VirtualAddressType {};
 
 template <> struct VirtualAddressType<TTGranule::Granule4K>